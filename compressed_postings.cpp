@@ -0,0 +1,163 @@
+#include "compressed_postings.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t LANE_COUNT = 4;
+constexpr size_t LANE_SIZE = CompressedPostings::BLOCK_SIZE / LANE_COUNT;
+constexpr double TERM_FREQ_SCALE = 4294967295.0;
+constexpr double INV_TERM_FREQ_SCALE = 1.0 / TERM_FREQ_SCALE;
+
+uint32_t GetBitWidth(uint32_t value) {
+    uint32_t bit_width = 0;
+    for (; value != 0; value >>= 1) {
+        ++bit_width;
+    }
+    return bit_width;
+}
+
+// Appends bit_width words per lane, word w of lane j going to position w * LANE_COUNT + j
+void PackBlock(const uint32_t* deltas, uint32_t bit_width, std::vector<uint32_t>& out) {
+    const size_t first = out.size();
+    out.resize(first + bit_width * LANE_COUNT, 0);
+    for (size_t i = 0; i < CompressedPostings::BLOCK_SIZE; ++i) {
+        const size_t lane = i % LANE_COUNT;
+        const uint32_t bit = static_cast<uint32_t>(i / LANE_COUNT) * bit_width;
+        const uint32_t word = bit / 32;
+        const uint32_t shift = bit % 32;
+        out[first + word * LANE_COUNT + lane] |= deltas[i] << shift;
+        if (shift + bit_width > 32) {
+            out[first + (word + 1) * LANE_COUNT + lane] |= deltas[i] >> (32 - shift);
+        }
+    }
+}
+
+void UnpackBlock(const uint32_t* packed, uint32_t bit_width, int base, int* ids) {
+    if (bit_width == 0) {
+        std::fill(ids, ids + CompressedPostings::BLOCK_SIZE, base);
+        return;
+    }
+#ifdef __SSE2__
+    const __m128i* in = reinterpret_cast<const __m128i*>(packed);
+    const __m128i mask = _mm_set1_epi32(bit_width == 32 ? -1 : static_cast<int>((1u << bit_width) - 1));
+    __m128i previous = _mm_set1_epi32(base);
+    for (uint32_t row = 0; row < LANE_SIZE; ++row) {
+        const uint32_t bit = row * bit_width;
+        const uint32_t word = bit / 32;
+        const uint32_t shift = bit % 32;
+        __m128i deltas = _mm_srl_epi32(_mm_loadu_si128(in + word), _mm_cvtsi32_si128(shift));
+        if (shift + bit_width > 32) {
+            deltas = _mm_or_si128(deltas,
+                _mm_sll_epi32(_mm_loadu_si128(in + word + 1), _mm_cvtsi32_si128(32 - shift)));
+        }
+        deltas = _mm_and_si128(deltas, mask);
+        // Prefix sum of the four deltas of the row on top of the last id of the previous row
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+        deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+        previous = _mm_add_epi32(deltas, _mm_shuffle_epi32(previous, 0xFF));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(ids + row * LANE_COUNT), previous);
+    }
+#else
+    const uint32_t mask = bit_width == 32 ? ~0u : (1u << bit_width) - 1;
+    uint32_t previous = static_cast<uint32_t>(base);
+    for (size_t i = 0; i < CompressedPostings::BLOCK_SIZE; ++i) {
+        const size_t lane = i % LANE_COUNT;
+        const uint32_t bit = static_cast<uint32_t>(i / LANE_COUNT) * bit_width;
+        const uint32_t word = bit / 32;
+        const uint32_t shift = bit % 32;
+        uint32_t delta = packed[word * LANE_COUNT + lane] >> shift;
+        if (shift + bit_width > 32) {
+            delta |= packed[(word + 1) * LANE_COUNT + lane] << (32 - shift);
+        }
+        previous += delta & mask;
+        ids[i] = static_cast<int>(previous);
+    }
+#endif
+}
+
+void DecodeTermFreqs(const uint32_t* quantized, size_t count, double* term_freqs) {
+    size_t i = 0;
+#ifdef __SSE2__
+    // SSE2 converts signed integers only: flip the sign bit and add 2^31 back as a double,
+    // which is exact and matches the scalar conversion
+    const __m128i sign_bit = _mm_set1_epi32(static_cast<int>(0x80000000u));
+    const __m128d sign_offset = _mm_set1_pd(2147483648.0);
+    const __m128d scale = _mm_set1_pd(INV_TERM_FREQ_SCALE);
+    for (; i + 4 <= count; i += 4) {
+        const __m128i values = _mm_xor_si128(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(quantized + i)), sign_bit);
+        const __m128d low = _mm_add_pd(_mm_cvtepi32_pd(values), sign_offset);
+        const __m128d high = _mm_add_pd(_mm_cvtepi32_pd(_mm_srli_si128(values, 8)), sign_offset);
+        _mm_storeu_pd(term_freqs + i, _mm_mul_pd(low, scale));
+        _mm_storeu_pd(term_freqs + i + 2, _mm_mul_pd(high, scale));
+    }
+#endif
+    for (; i < count; ++i) {
+        term_freqs[i] = quantized[i] * INV_TERM_FREQ_SCALE;
+    }
+}
+
+} // namespace
+
+CompressedPostings::CompressedPostings(const int* document_ids, const double* term_freqs, size_t count) {
+    const size_t full_block_count = count / BLOCK_SIZE;
+    block_last_ids_.reserve(full_block_count + 1);
+    bit_widths_.reserve(full_block_count);
+    block_offsets_.reserve(full_block_count);
+
+    uint32_t deltas[BLOCK_SIZE];
+    int base = 0;
+    for (size_t block = 0; block < full_block_count; ++block) {
+        const int* ids = document_ids + block * BLOCK_SIZE;
+        uint32_t all_bits = 0;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+            deltas[i] = static_cast<uint32_t>(ids[i] - (i == 0 ? base : ids[i - 1]));
+            all_bits |= deltas[i];
+        }
+        const uint32_t bit_width = GetBitWidth(all_bits);
+        bit_widths_.push_back(static_cast<uint8_t>(bit_width));
+        block_offsets_.push_back(static_cast<uint32_t>(packed_deltas_.size()));
+        PackBlock(deltas, bit_width, packed_deltas_);
+        base = ids[BLOCK_SIZE - 1];
+        block_last_ids_.push_back(base);
+    }
+    tail_ids_.assign(document_ids + full_block_count * BLOCK_SIZE, document_ids + count);
+    if (!tail_ids_.empty()) {
+        block_last_ids_.push_back(tail_ids_.back());
+    }
+
+    term_freqs_.resize(count);
+    std::transform(term_freqs, term_freqs + count, term_freqs_.begin(), [](double term_freq) {
+        return static_cast<uint32_t>(std::round(std::clamp(term_freq, 0.0, 1.0) * TERM_FREQ_SCALE));
+    });
+}
+
+size_t CompressedPostings::FindBlock(int document_id) const {
+    return std::lower_bound(block_last_ids_.begin(), block_last_ids_.end(), document_id) - block_last_ids_.begin();
+}
+
+size_t CompressedPostings::DecodeBlock(size_t block, int* document_ids, double* term_freqs) const {
+    const size_t first = block * BLOCK_SIZE;
+    size_t count = BLOCK_SIZE;
+    if (block < bit_widths_.size()) {
+        UnpackBlock(packed_deltas_.data() + block_offsets_[block], bit_widths_[block],
+            block == 0 ? 0 : block_last_ids_[block - 1], document_ids);
+    } else {
+        count = tail_ids_.size();
+        std::copy(tail_ids_.begin(), tail_ids_.end(), document_ids);
+    }
+    DecodeTermFreqs(term_freqs_.data() + first, count, term_freqs);
+    return count;
+}
+
+size_t CompressedPostings::MemoryUsage() const {
+    return block_last_ids_.capacity() * sizeof(int) + bit_widths_.capacity() * sizeof(uint8_t)
+        + block_offsets_.capacity() * sizeof(uint32_t) + packed_deltas_.capacity() * sizeof(uint32_t)
+        + tail_ids_.capacity() * sizeof(int) + term_freqs_.capacity() * sizeof(uint32_t);
+}
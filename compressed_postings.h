@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Read-only compressed form of a posting list.
+//
+// Document ids are cut into blocks of BLOCK_SIZE and stored as deltas to the previous id,
+// bit-packed with the width of the largest delta of their block. Deltas of a block are spread
+// over four 32-bit lanes (delta i goes to lane i % 4), so that SSE2 unpacks and prefix-sums
+// four ids per instruction; other targets use an equivalent scalar decoder. The ids of the
+// last, partial block are kept as is.
+//
+// Term frequencies are rounded to 32-bit fixed point in [0, 1]. Every decoded frequency is
+// within TERM_FREQ_ERROR of the original one, so the relevance of a document changes by less
+// than TERM_FREQ_ERROR * IDF <= 5.1e-9 per plus word (IDF never exceeds ln(INT_MAX) < 21.5).
+// That is below DELTA / 190: only documents whose exact relevances are within DELTA plus twice
+// that error of each other can be ordered differently than with exact frequencies.
+class CompressedPostings {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+    static constexpr double TERM_FREQ_ERROR = 1.0 / 4294967296.0;
+
+    // document_ids must be ascending and non-negative, term_freqs within [0, 1]
+    CompressedPostings(const int* document_ids, const double* term_freqs, size_t count);
+
+    size_t size() const {
+        return term_freqs_.size();
+    }
+
+    size_t BlockCount() const {
+        return block_last_ids_.size();
+    }
+
+    int BlockLastId(size_t block) const {
+        return block_last_ids_[block];
+    }
+
+    // First block that may contain document_id, BlockCount() if its id is greater than every id
+    size_t FindBlock(int document_id) const;
+
+    // Decodes a block into buffers of BLOCK_SIZE items, returns the number of its postings
+    size_t DecodeBlock(size_t block, int* document_ids, double* term_freqs) const;
+
+    size_t MemoryUsage() const;
+
+private:
+    std::vector<int> block_last_ids_;
+    // Bit widths and packed data offsets of the full blocks
+    std::vector<uint8_t> bit_widths_;
+    std::vector<uint32_t> block_offsets_;
+    std::vector<uint32_t> packed_deltas_;
+    std::vector<int> tail_ids_;
+    std::vector<uint32_t> term_freqs_;
+};
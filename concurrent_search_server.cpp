@@ -0,0 +1,123 @@
+#include "concurrent_search_server.h"
+
+#include <functional>
+#include <thread>
+
+ConcurrentSearchServer::ConcurrentSearchServer(const SearchServer& search_server)
+    : versions_{ std::make_unique<SearchServer>(search_server), std::make_unique<SearchServer>(search_server) } {
+    for (const std::unique_ptr<SearchServer>& version : versions_) {
+        version->SetMergeOnSeal(false);
+        version->SetCompactOnRemove(false);
+    }
+    maintenance_thread_ = std::thread([this]() { MaintainIndex(); });
+    RequestMaintenance();
+}
+
+ConcurrentSearchServer::~ConcurrentSearchServer() {
+    {
+        std::lock_guard guard(maintenance_mutex_);
+        stop_maintenance_ = true;
+    }
+    maintenance_condition_.notify_one();
+    maintenance_thread_.join();
+}
+
+int ConcurrentSearchServer::GetDocumentCount() const {
+    return Read([](const SearchServer& search_server) { return search_server.GetDocumentCount(); });
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    Write([&](SearchServer& search_server) {
+        search_server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Write([document_id](SearchServer& search_server) {
+        search_server.RemoveDocument(document_id);
+    });
+}
+
+size_t ConcurrentSearchServer::GetReaderSlot() {
+    thread_local const size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_SLOT_COUNT;
+    return slot;
+}
+
+size_t ConcurrentSearchServer::BeginRead(size_t slot) const {
+    // The count is raised before the version is checked again and the writer switches versions
+    // before it reads the counts, so either the writer sees the reader or the reader sees the
+    // switch and moves to the new version, never touching the old one
+    size_t version = current_.load(std::memory_order_seq_cst);
+    while (true) {
+        reader_counts_[version][slot].count.fetch_add(1, std::memory_order_seq_cst);
+        const size_t current = current_.load(std::memory_order_seq_cst);
+        if (current == version) {
+            return version;
+        }
+        EndRead(version, slot);
+        version = current;
+    }
+}
+
+void ConcurrentSearchServer::WaitForReaders(size_t version) const {
+    for (const ReaderCount& reader_count : reader_counts_[version]) {
+        while (reader_count.count.load(std::memory_order_seq_cst) != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void ConcurrentSearchServer::ResetStandby() {
+    // Nobody reads the standby version, and the current one is only read
+    const size_t current = current_.load(std::memory_order_relaxed);
+    versions_[1 - current] = std::make_unique<SearchServer>(*versions_[current]);
+}
+
+void ConcurrentSearchServer::RequestMaintenance() {
+    {
+        std::lock_guard guard(maintenance_mutex_);
+        maintenance_requested_ = true;
+    }
+    maintenance_condition_.notify_one();
+}
+
+void ConcurrentSearchServer::MaintainIndex() {
+    std::unique_lock lock(maintenance_mutex_);
+    while (true) {
+        maintenance_condition_.wait(lock, [this]() { return maintenance_requested_ || stop_maintenance_; });
+        if (stop_maintenance_) {
+            return;
+        }
+        maintenance_requested_ = false;
+        lock.unlock();
+
+        // Updates published while a merge is built keep going; lists they change keep their runs
+        while (!stop_maintenance_) {
+            std::optional<SearchServer::SegmentMerge> merge = Read([](const SearchServer& search_server) {
+                return search_server.PrepareSegmentMerge();
+            });
+            if (!merge) {
+                break;
+            }
+            merge->Build();
+            Write([&merge](SearchServer& search_server) {
+                search_server.ApplySegmentMerge(*merge);
+            });
+        }
+
+        // Documents added or removed while a compaction is built are carried over by applying it
+        if (!stop_maintenance_) {
+            std::optional<SearchServer::Compaction> compaction = Read([](const SearchServer& search_server) {
+                return search_server.PrepareCompaction();
+            });
+            if (compaction) {
+                compaction->Build();
+                Write([&compaction](SearchServer& search_server) {
+                    search_server.ApplyCompaction(*compaction);
+                });
+            }
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include "search_server.h"
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// SearchServer shared by queries and updates running in any threads. Queries never wait for
+// updates: they read an index version nobody changes.
+//
+// Two copies of the index are kept. An update is applied to the standby copy, which is then
+// published with a single atomic store. Queries that started on the former version finish on it;
+// once they are gone the same update is applied to it and it becomes the standby one. Readers
+// announce themselves in counters of the version they read, spread over cache lines by thread,
+// so that the writer can tell when a version is quiescent without readers sharing a lock.
+//
+// Updates are serialized and must be deterministic, since each one is applied twice.
+//
+// Sealed segments are merged and removed documents are compacted by a background thread: a merge
+// or a compaction is prepared from the current version, built while queries and updates go on,
+// and applied to both versions as an update. Removals themselves only mark documents.
+class ConcurrentSearchServer {
+public:
+    explicit ConcurrentSearchServer(const SearchServer& search_server);
+    // Waits for the merge or compaction in progress, if any
+    ~ConcurrentSearchServer();
+
+    // Calls query(const SearchServer&) on the current version and returns its result
+    template <typename Query>
+    auto Read(Query query) const;
+
+    // Takes the arguments of SearchServer::FindTopDocuments
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    int GetDocumentCount() const;
+
+    // Calls update(SearchServer&) to change the index and publishes the result. Several changes
+    // made in one update become visible to queries at once. If update throws on the standby
+    // version, no change is published and the exception is rethrown. Once published the change
+    // stands: if applying it to the former version throws, that version is copied from the
+    // published one instead and Write returns normally.
+    template <typename Update>
+    void Write(Update update);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+private:
+    static constexpr size_t READER_SLOT_COUNT = 64;
+
+    struct alignas(64) ReaderCount {
+        std::atomic<size_t> count = 0;
+    };
+
+    std::array<std::unique_ptr<SearchServer>, 2> versions_;
+    // Index in versions_ of the version new queries read
+    std::atomic<size_t> current_ = 0;
+    mutable std::array<std::array<ReaderCount, READER_SLOT_COUNT>, 2> reader_counts_;
+    std::mutex write_mutex_;
+
+    std::mutex maintenance_mutex_;
+    std::condition_variable maintenance_condition_;
+    bool maintenance_requested_ = false;
+    std::atomic<bool> stop_maintenance_ = false;
+    // Started last, stopped first
+    std::thread maintenance_thread_;
+
+    static size_t GetReaderSlot();
+
+    // Registers a reader of the current version and returns its index
+    size_t BeginRead(size_t slot) const;
+
+    void EndRead(size_t version, size_t slot) const {
+        reader_counts_[version][slot].count.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Returns once no query reads the version
+    void WaitForReaders(size_t version) const;
+
+    // Makes the standby version a copy of the current one
+    void ResetStandby();
+
+    // Wakes the background thread to look for segments to merge and removed documents to compact
+    void RequestMaintenance();
+    void MaintainIndex();
+};
+
+template <typename Query>
+auto ConcurrentSearchServer::Read(Query query) const {
+    struct ReadGuard {
+        const ConcurrentSearchServer& server;
+        size_t slot;
+        size_t version;
+
+        ~ReadGuard() {
+            server.EndRead(version, slot);
+        }
+    };
+
+    const size_t slot = GetReaderSlot();
+    const ReadGuard guard{ *this, slot, BeginRead(slot) };
+    return query(static_cast<const SearchServer&>(*versions_[guard.version]));
+}
+
+template <typename... Args>
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(Args&&... args) const {
+    return Read([&args...](const SearchServer& search_server) {
+        return search_server.FindTopDocuments(std::forward<Args>(args)...);
+    });
+}
+
+template <typename Update>
+void ConcurrentSearchServer::Write(Update update) {
+    std::lock_guard guard(write_mutex_);
+    const size_t current = current_.load(std::memory_order_relaxed);
+    const size_t standby = 1 - current;
+
+    try {
+        update(*versions_[standby]);
+    } catch (...) {
+        ResetStandby();
+        throw;
+    }
+    current_.store(standby, std::memory_order_seq_cst);
+
+    WaitForReaders(current);
+    try {
+        update(*versions_[current]);
+    } catch (...) {
+        // Queries already see the change, so the former version catches up by copying
+        ResetStandby();
+    }
+    RequestMaintenance();
+}
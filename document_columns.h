@@ -0,0 +1,108 @@
+#pragma once
+
+#include "document.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Attributes of indexed documents, stored column by column and indexed by internal document
+// number. Numbers are handed out densely in the order documents are added: a removed document
+// keeps its row with the live bit cleared until DropRows drops it and renumbers the others.
+//
+// Liveness and every status are also kept as bitmaps with a bit per row, so that filters can be
+// applied to 64 documents at once. Status bitmaps hold live documents only.
+class DocumentColumns {
+public:
+    static constexpr size_t STATUS_COUNT = static_cast<size_t>(DocumentStatus::REMOVED) + 1;
+
+    // Number of rows, removed documents included
+    size_t size() const {
+        return ids_.size();
+    }
+
+    void Reserve(size_t row_count) {
+        ids_.reserve(row_count);
+        ratings_.reserve(row_count);
+        statuses_.reserve(row_count);
+        live_.reserve((row_count + 63) / 64);
+        for (std::vector<uint64_t>& status_bits : status_bits_) {
+            status_bits.reserve((row_count + 63) / 64);
+        }
+    }
+
+    // Appends a row for a live document and returns its number
+    int Add(int document_id, int rating, DocumentStatus status) {
+        const int document_number = static_cast<int>(ids_.size());
+        ids_.push_back(document_id);
+        ratings_.push_back(rating);
+        statuses_.push_back(status);
+        if (document_number % 64 == 0) {
+            live_.push_back(0);
+            for (std::vector<uint64_t>& status_bits : status_bits_) {
+                status_bits.push_back(0);
+            }
+        }
+        live_.back() |= uint64_t{ 1 } << (document_number % 64);
+        status_bits_[static_cast<size_t>(status)].back() |= uint64_t{ 1 } << (document_number % 64);
+        return document_number;
+    }
+
+    void Remove(int document_number) {
+        const uint64_t mask = ~(uint64_t{ 1 } << (document_number % 64));
+        live_[document_number / 64] &= mask;
+        status_bits_[static_cast<size_t>(statuses_[document_number])][document_number / 64] &= mask;
+    }
+
+    // Drops the rows for which is_dropped(document_number) holds, the others keep their order
+    // and liveness and are numbered densely
+    template <typename Predicate>
+    void DropRows(Predicate is_dropped) {
+        DocumentColumns kept;
+        for (int document_number = 0; document_number < static_cast<int>(size()); ++document_number) {
+            if (is_dropped(document_number)) {
+                continue;
+            }
+            const int kept_number = kept.Add(ids_[document_number], ratings_[document_number],
+                statuses_[document_number]);
+            if (!IsLive(document_number)) {
+                kept.Remove(kept_number);
+            }
+        }
+        *this = std::move(kept);
+    }
+
+    bool IsLive(int document_number) const {
+        return (live_[document_number / 64] >> (document_number % 64)) & 1;
+    }
+
+    // Bitmaps of (size() + 63) / 64 words, bit i of word j stands for document number j * 64 + i
+    const uint64_t* GetLiveBits() const {
+        return live_.data();
+    }
+
+    const uint64_t* GetStatusBits(DocumentStatus status) const {
+        return status_bits_[static_cast<size_t>(status)].data();
+    }
+
+    int GetId(int document_number) const {
+        return ids_[document_number];
+    }
+
+    int GetRating(int document_number) const {
+        return ratings_[document_number];
+    }
+
+    DocumentStatus GetStatus(int document_number) const {
+        return statuses_[document_number];
+    }
+
+private:
+    std::vector<int> ids_;
+    std::vector<int> ratings_;
+    std::vector<DocumentStatus> statuses_;
+    // Bit per row
+    std::vector<uint64_t> live_;
+    std::array<std::vector<uint64_t>, STATUS_COUNT> status_bits_;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "document.h"
+
+// Built-in document predicates. They can be passed wherever a document predicate is expected;
+// FindTopDocuments recognizes them by type and compiles a scoring loop that filters documents
+// with the document bitmaps and columns instead of calling the predicate for every match.
+
+// Accepts every document
+struct AnyDocument {
+    bool operator()(int document_id, DocumentStatus status, int rating) const {
+        return true;
+    }
+};
+
+// Accepts documents with the given status
+struct DocumentStatusIs {
+    DocumentStatus status;
+
+    bool operator()(int document_id, DocumentStatus document_status, int rating) const {
+        return document_status == status;
+    }
+};
+
+// Accepts documents rated min_rating or higher
+struct DocumentRatingAtLeast {
+    int min_rating;
+
+    bool operator()(int document_id, DocumentStatus status, int rating) const {
+        return rating >= min_rating;
+    }
+};
@@ -0,0 +1,26 @@
+#include "idf_cache.h"
+
+IdfCache::IdfCache(const IdfCache& other) {
+    *this = other;
+}
+
+IdfCache& IdfCache::operator=(const IdfCache& other) {
+    if (this == &other) {
+        return *this;
+    }
+    entries_.clear();
+    Resize(other.entries_.size());
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        entries_[i].epoch = other.entries_[i].epoch.load();
+        entries_[i].inverse_document_freq = other.entries_[i].inverse_document_freq.load();
+    }
+    hit_count_ = other.hit_count_.load();
+    miss_count_ = other.miss_count_.load();
+    return *this;
+}
+
+void IdfCache::Resize(size_t term_count) {
+    while (entries_.size() < term_count) {
+        entries_.emplace_back();
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "term_dictionary.h"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+
+struct IdfCacheStats {
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+
+    double HitRate() const {
+        const size_t total = hit_count + miss_count;
+        return total == 0 ? 0.0 : static_cast<double>(hit_count) / total;
+    }
+};
+
+// Inverse document frequencies of terms, each remembered together with the index epoch it was
+// computed for. Index mutations only advance the epoch, so any number of them invalidates the
+// cache at once and a term is recomputed on its first lookup afterwards.
+// Lookups may run concurrently with each other, but not with Resize or a change of the epoch.
+class IdfCache {
+public:
+    IdfCache() = default;
+    IdfCache(const IdfCache& other);
+    IdfCache& operator=(const IdfCache& other);
+
+    // Makes room for terms [0, term_count)
+    void Resize(size_t term_count);
+
+    // compute() is called on a miss and must return the IDF of the term for the current index state
+    template <typename Compute>
+    double Get(TermId term, uint64_t epoch, Compute compute) const;
+
+    IdfCacheStats GetStats() const {
+        return { hit_count_.load(std::memory_order_relaxed), miss_count_.load(std::memory_order_relaxed) };
+    }
+
+private:
+    struct Entry {
+        // Epoch 0 is never current, so new entries start invalid
+        std::atomic<uint64_t> epoch = 0;
+        std::atomic<double> inverse_document_freq = 0.0;
+    };
+
+    // deque keeps entries in place when the cache grows
+    mutable std::deque<Entry> entries_;
+    mutable std::atomic<size_t> hit_count_ = 0;
+    mutable std::atomic<size_t> miss_count_ = 0;
+};
+
+template <typename Compute>
+double IdfCache::Get(TermId term, uint64_t epoch, Compute compute) const {
+    Entry& entry = entries_[term];
+    if (entry.epoch.load(std::memory_order_acquire) == epoch) {
+        hit_count_.fetch_add(1, std::memory_order_relaxed);
+        return entry.inverse_document_freq.load(std::memory_order_relaxed);
+    }
+
+    // Concurrent misses of one term store the same value, so the race between them is benign
+    const double inverse_document_freq = compute();
+    entry.inverse_document_freq.store(inverse_document_freq, std::memory_order_relaxed);
+    entry.epoch.store(epoch, std::memory_order_release);
+    miss_count_.fetch_add(1, std::memory_order_relaxed);
+    return inverse_document_freq;
+}
@@ -0,0 +1,297 @@
+#include "index_snapshot.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::string_literals;
+
+namespace {
+
+constexpr char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+// Written as a native integer, so a file from a machine with another byte order is rejected
+constexpr uint32_t BYTE_ORDER_MARK = 0x01020304;
+
+uint64_t AlignOffset(uint64_t offset) {
+    return (offset + 7) / 8 * 8;
+}
+
+// size must be a multiple of 8
+uint64_t UpdateChecksum(uint64_t checksum, const char* data, size_t size) {
+    for (size_t i = 0; i < size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        checksum = (checksum ^ word) * 0x9E3779B97F4A7C15ull;
+        checksum ^= checksum >> 29;
+    }
+    return checksum;
+}
+
+constexpr uint64_t CHECKSUM_SEED = 0xCBF29CE484222325ull;
+
+// Offsets must start at 0, never decrease and end at total
+bool AreValidOffsets(const uint64_t* offsets, uint64_t count, uint64_t total) {
+    return offsets[0] == 0 && offsets[count] == total && std::is_sorted(offsets, offsets + count + 1);
+}
+
+} // namespace
+
+IndexSnapshotLayout::IndexSnapshotLayout(const IndexSnapshotHeader& header) {
+    uint64_t offset = sizeof(IndexSnapshotHeader);
+    auto place = [&offset](uint64_t& array_offset, uint64_t count, uint64_t item_size) {
+        array_offset = AlignOffset(offset);
+        offset = array_offset + count * item_size;
+    };
+    place(stop_word_offsets, header.stop_word_count + 1, sizeof(uint64_t));
+    place(stop_word_chars, header.stop_word_bytes, sizeof(char));
+    place(term_offsets, header.term_count + 1, sizeof(uint64_t));
+    place(term_chars, header.term_bytes, sizeof(char));
+    place(posting_offsets, header.term_count + 1, sizeof(uint64_t));
+    place(max_term_freqs, header.term_count, sizeof(double));
+    place(posting_ids, header.posting_count, sizeof(int));
+    place(posting_term_freqs, header.posting_count, sizeof(double));
+    place(document_ids, header.document_count, sizeof(int));
+    place(document_ratings, header.document_count, sizeof(int));
+    place(document_statuses, header.document_count, sizeof(int));
+    place(document_term_offsets, header.document_count + 1, sizeof(uint64_t));
+    place(document_terms, header.document_term_count, sizeof(TermId));
+    place(document_term_freqs, header.document_term_count, sizeof(double));
+    file_size = AlignOffset(offset);
+}
+
+IndexSnapshotWriter::IndexSnapshotWriter(const std::string& path, const IndexSnapshotHeader& header)
+    : path_(path)
+    , temp_path_(path + ".tmp"s)
+    , out_(temp_path_, std::ios::binary | std::ios::trunc)
+    , header_(header)
+    , layout_(header)
+    , position_(sizeof(IndexSnapshotHeader))
+    , checksum_(CHECKSUM_SEED) {
+    if (!out_) {
+        throw std::runtime_error("cannot create snapshot file "s + path);
+    }
+    // Placeholder, the header is written by Finish
+    const IndexSnapshotHeader empty_header{};
+    out_.write(reinterpret_cast<const char*>(&empty_header), sizeof(empty_header));
+    buffer_.reserve(BUFFER_SIZE);
+}
+
+IndexSnapshotWriter::~IndexSnapshotWriter() {
+    if (!finished_) {
+        out_.close();
+        std::remove(temp_path_.c_str());
+    }
+}
+
+void IndexSnapshotWriter::StartArray(uint64_t offset) {
+    if (offset < position_) {
+        throw std::logic_error("snapshot arrays written out of order"s);
+    }
+    static const char padding[8] = {};
+    while (position_ < offset) {
+        WriteBytes(padding, std::min<uint64_t>(sizeof(padding), offset - position_));
+    }
+}
+
+void IndexSnapshotWriter::WriteBytes(const char* data, size_t size) {
+    position_ += size;
+    while (size > 0) {
+        const size_t chunk = std::min(size, BUFFER_SIZE - buffer_.size());
+        buffer_.insert(buffer_.end(), data, data + chunk);
+        data += chunk;
+        size -= chunk;
+        if (buffer_.size() == BUFFER_SIZE) {
+            Flush();
+        }
+    }
+}
+
+void IndexSnapshotWriter::Finish() {
+    StartArray(layout_.file_size);
+    if (position_ != layout_.file_size) {
+        throw std::logic_error("snapshot size does not match its header"s);
+    }
+    Flush();
+
+    std::copy(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header_.magic);
+    header_.version = IndexSnapshot::VERSION;
+    header_.byte_order = BYTE_ORDER_MARK;
+    header_.file_size = layout_.file_size;
+    header_.checksum = checksum_;
+    out_.seekp(0);
+    out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+    out_.close();
+    if (!out_) {
+        throw std::runtime_error("cannot write snapshot file"s);
+    }
+    // A file mapped from path keeps its inode, truncating it in place would break the mapping
+    if (std::rename(temp_path_.c_str(), path_.c_str()) != 0) {
+        throw std::runtime_error("cannot replace snapshot file "s + path_);
+    }
+    finished_ = true;
+}
+
+void IndexSnapshotWriter::Flush() {
+    checksum_ = UpdateChecksum(checksum_, buffer_.data(), buffer_.size());
+    out_.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
+}
+
+IndexSnapshot::IndexSnapshot(const std::string& path) {
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open snapshot file "s + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || file_stat.st_size < static_cast<off_t>(sizeof(IndexSnapshotHeader))) {
+        close(fd);
+        throw std::runtime_error("snapshot file is truncated"s);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        throw std::runtime_error("cannot map snapshot file "s + path);
+    }
+    data_ = static_cast<const char*>(data);
+
+    try {
+        Load();
+    } catch (...) {
+        munmap(const_cast<char*>(data_), size_);
+        throw;
+    }
+}
+
+IndexSnapshot::~IndexSnapshot() {
+    munmap(const_cast<char*>(data_), size_);
+}
+
+std::vector<std::string_view> IndexSnapshot::GetStopWords() const {
+    std::vector<std::string_view> stop_words(header_->stop_word_count);
+    for (size_t i = 0; i < stop_words.size(); ++i) {
+        stop_words[i] = GetString(stop_word_offsets_, stop_word_chars_, i);
+    }
+    return stop_words;
+}
+
+void IndexSnapshot::Load() {
+    header_ = GetArray<IndexSnapshotHeader>(0);
+    if (!std::equal(std::begin(SNAPSHOT_MAGIC), std::end(SNAPSHOT_MAGIC), header_->magic)) {
+        throw std::runtime_error("not a search server snapshot"s);
+    }
+    if (header_->version != VERSION || header_->byte_order != BYTE_ORDER_MARK) {
+        throw std::runtime_error("unsupported snapshot version"s);
+    }
+    // Counts are bounded by the file size first, so that the layout cannot overflow
+    const uint64_t counts[] = { header_->stop_word_count, header_->stop_word_bytes, header_->term_count,
+        header_->term_bytes, header_->posting_count, header_->document_count, header_->document_term_count };
+    if (header_->file_size != size_ || std::any_of(std::begin(counts), std::end(counts),
+        [this](uint64_t count) { return count > size_; })) {
+        throw std::runtime_error("snapshot file is truncated"s);
+    }
+    const IndexSnapshotLayout layout(*header_);
+    if (layout.file_size != size_) {
+        throw std::runtime_error("snapshot file is truncated"s);
+    }
+    const size_t header_size = sizeof(IndexSnapshotHeader);
+    if (UpdateChecksum(CHECKSUM_SEED, data_ + header_size, size_ - header_size) != header_->checksum) {
+        throw std::runtime_error("snapshot checksum mismatch"s);
+    }
+
+    stop_word_offsets_ = GetArray<uint64_t>(layout.stop_word_offsets);
+    stop_word_chars_ = GetArray<char>(layout.stop_word_chars);
+    term_offsets_ = GetArray<uint64_t>(layout.term_offsets);
+    term_chars_ = GetArray<char>(layout.term_chars);
+    posting_offsets_ = GetArray<uint64_t>(layout.posting_offsets);
+    max_term_freqs_ = GetArray<double>(layout.max_term_freqs);
+    posting_ids_ = GetArray<int>(layout.posting_ids);
+    posting_term_freqs_ = GetArray<double>(layout.posting_term_freqs);
+    document_ids_ = GetArray<int>(layout.document_ids);
+    document_ratings_ = GetArray<int>(layout.document_ratings);
+    document_statuses_ = GetArray<int>(layout.document_statuses);
+    document_term_offsets_ = GetArray<uint64_t>(layout.document_term_offsets);
+    document_terms_ = GetArray<TermId>(layout.document_terms);
+    document_term_freqs_ = GetArray<double>(layout.document_term_freqs);
+
+    // The checksum catches damage, these checks keep a consistent but malformed file from
+    // sending lookups out of bounds or breaking the invariants the posting lists rely on
+    const uint64_t term_count = header_->term_count;
+    const uint64_t document_count = header_->document_count;
+    const bool valid_offsets = AreValidOffsets(stop_word_offsets_, header_->stop_word_count, header_->stop_word_bytes)
+        && AreValidOffsets(term_offsets_, term_count, header_->term_bytes)
+        && AreValidOffsets(posting_offsets_, term_count, header_->posting_count)
+        && AreValidOffsets(document_term_offsets_, document_count, header_->document_term_count);
+    const bool valid_documents = std::all_of(document_ids_, document_ids_ + document_count,
+            [](int document_id) { return document_id >= 0; })
+        && std::all_of(posting_ids_, posting_ids_ + header_->posting_count,
+            [document_count](int document_number) {
+                return document_number >= 0 && static_cast<uint64_t>(document_number) < document_count;
+            })
+        && std::all_of(document_statuses_, document_statuses_ + document_count, [](int status) {
+            return status >= static_cast<int>(DocumentStatus::ACTUAL) && status <= static_cast<int>(DocumentStatus::REMOVED);
+        })
+        && std::all_of(document_terms_, document_terms_ + header_->document_term_count,
+            [term_count](TermId term) { return term < term_count; });
+    if (!valid_offsets || !valid_documents || !HasValidTerms() || !HasConsistentPostings()) {
+        throw std::runtime_error("snapshot is malformed"s);
+    }
+}
+
+bool IndexSnapshot::HasValidTerms() const {
+    // SaveSnapshot writes an empty spelling exactly for the TermIds left without documents
+    for (TermId term = 0; term < header_->term_count; ++term) {
+        const bool has_spelling = term_offsets_[term + 1] != term_offsets_[term];
+        const bool has_postings = posting_offsets_[term + 1] != posting_offsets_[term];
+        if (has_spelling != has_postings) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool IndexSnapshot::HasConsistentPostings() const {
+    // Posting lists borrow the arrays as they are, and removals expect every id they drop to be
+    // in the list: the postings of every term must be strictly ascending and bounded by the
+    // stored maximum frequency
+    const uint64_t term_count = header_->term_count;
+    for (TermId term = 0; term < term_count; ++term) {
+        const uint64_t first = posting_offsets_[term];
+        const uint64_t last = posting_offsets_[term + 1];
+        for (uint64_t i = first; i < last; ++i) {
+            if ((i > first && posting_ids_[i - 1] >= posting_ids_[i]) || posting_term_freqs_[i] > max_term_freqs_[term]) {
+                return false;
+            }
+        }
+    }
+
+    // The forward index must hold exactly the postings: documents are visited in number order,
+    // so the next posting of every term of a document has to be that document
+    std::vector<uint64_t> next_postings(posting_offsets_, posting_offsets_ + term_count);
+    for (uint64_t document_number = 0; document_number < header_->document_count; ++document_number) {
+        const uint64_t first = document_term_offsets_[document_number];
+        const uint64_t last = document_term_offsets_[document_number + 1];
+        for (uint64_t i = first; i < last; ++i) {
+            const TermId term = document_terms_[i];
+            if ((i > first && document_terms_[i - 1] >= term) || next_postings[term] == posting_offsets_[term + 1]
+                || static_cast<uint64_t>(posting_ids_[next_postings[term]]) != document_number) {
+                return false;
+            }
+            ++next_postings[term];
+        }
+    }
+    for (TermId term = 0; term < term_count; ++term) {
+        if (next_postings[term] != posting_offsets_[term + 1]) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "document.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Snapshot file layout, in native byte order with every array aligned to 8 bytes:
+//   IndexSnapshotHeader
+//   stop words:    uint64 offsets[stop_word_count + 1], chars[stop_word_bytes]
+//   terms:         uint64 offsets[term_count + 1], chars[term_bytes], empty terms mark unused TermIds
+//   postings:      uint64 offsets[term_count + 1], double max_term_freqs[term_count],
+//                  int32 document numbers[posting_count], double term_freqs[posting_count]
+//   documents:     int32 ids[document_count], int32 ratings[document_count],
+//                  int32 statuses[document_count], uint64 term_offsets[document_count + 1]
+// Documents are stored in the order of their numbers, which index the document arrays.
+//   forward index: uint32 terms[document_term_count], double term_freqs[document_term_count]
+// The checksum covers everything after the header.
+struct IndexSnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint64_t stop_word_count;
+    uint64_t stop_word_bytes;
+    uint64_t term_count;
+    uint64_t term_bytes;
+    uint64_t posting_count;
+    uint64_t document_count;
+    uint64_t document_term_count;
+};
+
+// File offsets of the arrays of a snapshot with the given header
+struct IndexSnapshotLayout {
+    uint64_t stop_word_offsets = 0;
+    uint64_t stop_word_chars = 0;
+    uint64_t term_offsets = 0;
+    uint64_t term_chars = 0;
+    uint64_t posting_offsets = 0;
+    uint64_t max_term_freqs = 0;
+    uint64_t posting_ids = 0;
+    uint64_t posting_term_freqs = 0;
+    uint64_t document_ids = 0;
+    uint64_t document_ratings = 0;
+    uint64_t document_statuses = 0;
+    uint64_t document_term_offsets = 0;
+    uint64_t document_terms = 0;
+    uint64_t document_term_freqs = 0;
+    uint64_t file_size = 0;
+
+    explicit IndexSnapshotLayout(const IndexSnapshotHeader& header);
+};
+
+// Writes a snapshot array by array in layout order, padding up to the start of each array.
+// The arrays go to a temporary file next to path, which Finish renames to path, so a snapshot
+// mapped from path keeps reading the old file.
+class IndexSnapshotWriter {
+public:
+    // header must hold the counts, the rest of it is filled in by Finish
+    IndexSnapshotWriter(const std::string& path, const IndexSnapshotHeader& header);
+    // Removes the temporary file unless Finish has succeeded
+    ~IndexSnapshotWriter();
+
+    IndexSnapshotWriter(const IndexSnapshotWriter&) = delete;
+    IndexSnapshotWriter& operator=(const IndexSnapshotWriter&) = delete;
+
+    const IndexSnapshotLayout& GetLayout() const {
+        return layout_;
+    }
+
+    void StartArray(uint64_t offset);
+
+    template <typename T>
+    void Write(const T& value) {
+        WriteBytes(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void WriteBytes(const char* data, size_t size);
+
+    // Completes the header, throws std::logic_error if the written arrays do not match the counts
+    void Finish();
+
+private:
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    std::string path_;
+    std::string temp_path_;
+    std::ofstream out_;
+    bool finished_ = false;
+    IndexSnapshotHeader header_;
+    IndexSnapshotLayout layout_;
+    uint64_t position_;
+    uint64_t checksum_;
+    std::vector<char> buffer_;
+
+    void Flush();
+};
+
+// Snapshot file mapped into memory read-only. The file is checked on opening, after that
+// all accessors read the mapped pages directly. The checksum and the posting checks read the
+// whole file, so opening takes time linear in its size; duplicate spellings are left to the
+// dictionary built from the terms.
+class IndexSnapshot {
+public:
+    inline static constexpr uint32_t VERSION = 2;
+
+    // Throws std::runtime_error if the file cannot be mapped or is not an intact snapshot
+    explicit IndexSnapshot(const std::string& path);
+    ~IndexSnapshot();
+
+    IndexSnapshot(const IndexSnapshot&) = delete;
+    IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+
+    size_t FileSize() const {
+        return size_;
+    }
+
+    std::vector<std::string_view> GetStopWords() const;
+
+    size_t TermCount() const {
+        return header_->term_count;
+    }
+
+    std::string_view GetTerm(TermId term) const {
+        return GetString(term_offsets_, term_chars_, term);
+    }
+
+    // Borrows the arrays of the snapshot, which must outlive the list
+    PostingList GetPostings(TermId term) const {
+        const uint64_t first = posting_offsets_[term];
+        const size_t count = posting_offsets_[term + 1] - first;
+        return PostingList::MakeExternal(posting_ids_ + first, posting_term_freqs_ + first, count,
+            max_term_freqs_[term]);
+    }
+
+    size_t DocumentCount() const {
+        return header_->document_count;
+    }
+
+    int GetDocumentId(size_t document_number) const {
+        return document_ids_[document_number];
+    }
+
+    int GetDocumentRating(size_t document_number) const {
+        return document_ratings_[document_number];
+    }
+
+    DocumentStatus GetDocumentStatus(size_t document_number) const {
+        return static_cast<DocumentStatus>(document_statuses_[document_number]);
+    }
+
+    // Calls func(term, term_freq) for every term of the document in ascending TermId order
+    template <typename Func>
+    void ForEachDocumentTerm(size_t document_number, Func func) const {
+        for (uint64_t i = document_term_offsets_[document_number]; i < document_term_offsets_[document_number + 1]; ++i) {
+            func(document_terms_[i], document_term_freqs_[i]);
+        }
+    }
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    const IndexSnapshotHeader* header_ = nullptr;
+
+    const uint64_t* stop_word_offsets_ = nullptr;
+    const char* stop_word_chars_ = nullptr;
+    const uint64_t* term_offsets_ = nullptr;
+    const char* term_chars_ = nullptr;
+    const uint64_t* posting_offsets_ = nullptr;
+    const double* max_term_freqs_ = nullptr;
+    const int* posting_ids_ = nullptr;
+    const double* posting_term_freqs_ = nullptr;
+    const int* document_ids_ = nullptr;
+    const int* document_ratings_ = nullptr;
+    const int* document_statuses_ = nullptr;
+    const uint64_t* document_term_offsets_ = nullptr;
+    const TermId* document_terms_ = nullptr;
+    const double* document_term_freqs_ = nullptr;
+
+    template <typename T>
+    const T* GetArray(uint64_t offset) const {
+        return reinterpret_cast<const T*>(data_ + offset);
+    }
+
+    static std::string_view GetString(const uint64_t* offsets, const char* chars, size_t index) {
+        return { chars + offsets[index], offsets[index + 1] - offsets[index] };
+    }
+
+    // Checks the mapped file and sets up the arrays
+    void Load();
+    // Checks that exactly the terms with postings have spellings, the offsets must be valid already
+    bool HasValidTerms() const;
+    // Checks that the posting lists are sorted and agree with the forward index, the arrays
+    // must be in bounds already
+    bool HasConsistentPostings() const;
+};
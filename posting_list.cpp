@@ -0,0 +1,472 @@
+#include "posting_list.h"
+
+#include <algorithm>
+#include <iterator>
+
+PostingList PostingList::MakeExternal(const int* document_ids, const double* term_freqs, size_t count,
+    double max_term_freq) {
+    PostingList list;
+    if (count > 0) {
+        list.runs_.push_back({ document_ids, term_freqs, count, max_term_freq, nullptr });
+        list.run_posting_count_ = count;
+        list.max_term_freq_ = max_term_freq;
+    }
+    return list;
+}
+
+void PostingList::Add(int document_id, double term_freq) {
+    Materialize();
+    max_term_freq_ = std::max(max_term_freq_, term_freq);
+    if (pending_ids_.empty() && LastId() < document_id) {
+        ids_.push_back(document_id);
+        term_freqs_.push_back(term_freq);
+        return;
+    }
+
+    const auto pos = std::lower_bound(pending_ids_.begin(), pending_ids_.end(), document_id);
+    const auto offset = std::distance(pending_ids_.begin(), pos);
+    pending_ids_.insert(pos, document_id);
+    pending_term_freqs_.insert(pending_term_freqs_.begin() + offset, term_freq);
+
+    if (pending_ids_.size() > std::max(MIN_PENDING_LIMIT, (run_posting_count_ + ids_.size()) / 8)) {
+        MergePending();
+    }
+}
+
+void PostingList::AddSorted(const int* document_ids, const double* term_freqs, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    Materialize();
+    max_term_freq_ = std::max(max_term_freq_, *std::max_element(term_freqs, term_freqs + count));
+    if (pending_ids_.empty() && LastId() < document_ids[0]) {
+        ids_.insert(ids_.end(), document_ids, document_ids + count);
+        term_freqs_.insert(term_freqs_.end(), term_freqs, term_freqs + count);
+        return;
+    }
+
+    std::vector<int> ids;
+    std::vector<double> freqs;
+    ids.reserve(size() + count);
+    freqs.reserve(size() + count);
+    size_t i = 0;
+    for (Cursor cursor(*this); !cursor.AtEnd(); cursor.Next()) {
+        for (; i < count && document_ids[i] < cursor.DocumentId(); ++i) {
+            ids.push_back(document_ids[i]);
+            freqs.push_back(term_freqs[i]);
+        }
+        ids.push_back(cursor.DocumentId());
+        freqs.push_back(cursor.TermFreq());
+    }
+    ids.insert(ids.end(), document_ids + i, document_ids + count);
+    freqs.insert(freqs.end(), term_freqs + i, term_freqs + count);
+
+    runs_.clear();
+    run_posting_count_ = 0;
+    ids_.swap(ids);
+    term_freqs_.swap(freqs);
+    pending_ids_.clear();
+    pending_term_freqs_.clear();
+}
+
+void PostingList::Renumber(const std::vector<int>& new_ids) {
+    const bool was_compressed = IsCompressed();
+    Materialize();
+
+    // Ids of a run below the first changed id stay the same, such runs stay shared
+    size_t out = 0;
+    run_posting_count_ = 0;
+    for (RunView& run : runs_) {
+        if (new_ids[run.LastId()] != run.LastId()) {
+            RenumberRun(run, new_ids);
+            if (run.size == 0) {
+                continue;
+            }
+        }
+        run_posting_count_ += run.size;
+        if (&runs_[out] != &run) {
+            runs_[out] = std::move(run);
+        }
+        ++out;
+    }
+    runs_.erase(runs_.begin() + out, runs_.end());
+
+    auto renumber = [&new_ids](std::vector<int>& ids, std::vector<double>& term_freqs) {
+        size_t out = 0;
+        for (size_t i = 0; i < ids.size(); ++i) {
+            if (new_ids[ids[i]] >= 0) {
+                ids[out] = new_ids[ids[i]];
+                term_freqs[out] = term_freqs[i];
+                ++out;
+            }
+        }
+        ids.resize(out);
+        term_freqs.resize(out);
+    };
+    renumber(ids_, term_freqs_);
+    renumber(pending_ids_, pending_term_freqs_);
+    UpdateMaxTermFreq();
+    if (was_compressed) {
+        Compress();
+    }
+}
+
+void PostingList::AppendShifted(const PostingList& other, int first_id, int shift) {
+    Cursor cursor(other);
+    for (cursor.SeekGE(first_id); !cursor.AtEnd(); cursor.Next()) {
+        Add(cursor.DocumentId() - shift, cursor.TermFreq());
+    }
+}
+
+bool PostingList::Contains(int document_id) const {
+    if (compressed_) {
+        const size_t block = compressed_->FindBlock(document_id);
+        if (block == compressed_->BlockCount()) {
+            return false;
+        }
+        int ids[CompressedPostings::BLOCK_SIZE];
+        double term_freqs[CompressedPostings::BLOCK_SIZE];
+        const size_t count = compressed_->DecodeBlock(block, ids, term_freqs);
+        return std::binary_search(ids, ids + count, document_id);
+    }
+
+    const auto run = std::lower_bound(runs_.begin(), runs_.end(), document_id,
+        [](const RunView& run, int document_id) { return run.LastId() < document_id; });
+    if (run != runs_.end() && std::binary_search(run->document_ids, run->document_ids + run->size, document_id)) {
+        return true;
+    }
+    const auto pos = std::lower_bound(ids_.begin(), ids_.end(), document_id);
+    if (pos != ids_.end() && *pos == document_id) {
+        return true;
+    }
+    return std::binary_search(pending_ids_.begin(), pending_ids_.end(), document_id);
+}
+
+size_t PostingList::MemoryUsage() const {
+    size_t run_bytes = 0;
+    for (const RunView& run : runs_) {
+        if (run.run) {
+            run_bytes += run.run->document_ids.capacity() * sizeof(int) + run.run->term_freqs.capacity() * sizeof(double);
+        }
+    }
+    return run_bytes
+        + (ids_.capacity() + pending_ids_.capacity()) * sizeof(int)
+        + (term_freqs_.capacity() + pending_term_freqs_.capacity()) * sizeof(double)
+        + (compressed_ ? compressed_->MemoryUsage() : 0);
+}
+
+void PostingList::Compress() {
+    if (compressed_ || empty()) {
+        return;
+    }
+    std::vector<int> ids;
+    std::vector<double> term_freqs;
+    ids.reserve(size());
+    term_freqs.reserve(size());
+    ForEach([&ids, &term_freqs](int document_id, double term_freq) {
+        ids.push_back(document_id);
+        term_freqs.push_back(term_freq);
+    });
+    compressed_ = std::make_shared<const CompressedPostings>(ids.data(), term_freqs.data(), ids.size());
+    runs_ = std::vector<RunView>();
+    run_posting_count_ = 0;
+    ids_ = std::vector<int>();
+    term_freqs_ = std::vector<double>();
+    pending_ids_ = std::vector<int>();
+    pending_term_freqs_ = std::vector<double>();
+    UpdateMaxTermFreq();
+}
+
+void PostingList::Seal() {
+    if (compressed_) {
+        return;
+    }
+    MergePending();
+    if (ids_.size() < MIN_RUN_SIZE) {
+        return;
+    }
+    auto run = std::make_shared<PostingRun>();
+    run->document_ids.swap(ids_);
+    run->term_freqs.swap(term_freqs_);
+    run->document_ids.shrink_to_fit();
+    run->term_freqs.shrink_to_fit();
+    const double max_term_freq = *std::max_element(run->term_freqs.begin(), run->term_freqs.end());
+    runs_.push_back({ run->document_ids.data(), run->term_freqs.data(), run->document_ids.size(), max_term_freq, run });
+    run_posting_count_ += run->document_ids.size();
+}
+
+std::vector<PostingList::RunView> PostingList::GetRuns(int first_id, int last_id) const {
+    std::vector<RunView> runs;
+    for (const RunView& run : runs_) {
+        if (run.FirstId() >= first_id && run.LastId() < last_id) {
+            runs.push_back(run);
+        }
+    }
+    return runs;
+}
+
+PostingList::RunView PostingList::MergeRuns(const std::vector<RunView>& runs) {
+    auto merged = std::make_shared<PostingRun>();
+    size_t size = 0;
+    double max_term_freq = 0.0;
+    for (const RunView& run : runs) {
+        size += run.size;
+        max_term_freq = std::max(max_term_freq, run.max_term_freq);
+    }
+    merged->document_ids.reserve(size);
+    merged->term_freqs.reserve(size);
+    // Runs hold disjoint ascending ranges of ids, so the merge is a concatenation
+    for (const RunView& run : runs) {
+        merged->document_ids.insert(merged->document_ids.end(), run.document_ids, run.document_ids + run.size);
+        merged->term_freqs.insert(merged->term_freqs.end(), run.term_freqs, run.term_freqs + run.size);
+    }
+    return { merged->document_ids.data(), merged->term_freqs.data(), size, max_term_freq, merged };
+}
+
+bool PostingList::ReplaceRuns(int first_id, int last_id, const RunView& merged) {
+    if (compressed_) {
+        return false;
+    }
+    // Runs never gain postings, so the same count means the same postings
+    auto first = runs_.begin();
+    while (first != runs_.end() && first->FirstId() < first_id) {
+        ++first;
+    }
+    auto last = first;
+    size_t size = 0;
+    for (; last != runs_.end() && last->LastId() < last_id; ++last) {
+        size += last->size;
+    }
+    if (size != merged.size || first == last) {
+        return false;
+    }
+    *first = merged;
+    runs_.erase(first + 1, last);
+    return true;
+}
+
+void PostingList::Materialize() {
+    if (!compressed_) {
+        return;
+    }
+    ids_.clear();
+    term_freqs_.clear();
+    ids_.reserve(compressed_->size());
+    term_freqs_.reserve(compressed_->size());
+    ForEach([this](int document_id, double term_freq) {
+        ids_.push_back(document_id);
+        term_freqs_.push_back(term_freq);
+    });
+    compressed_.reset();
+}
+
+void PostingList::MergePending() {
+    if (pending_ids_.empty()) {
+        return;
+    }
+    Materialize();
+
+    std::vector<int> ids;
+    std::vector<double> term_freqs;
+    ids.reserve(size());
+    term_freqs.reserve(size());
+    ForEach([&ids, &term_freqs](int document_id, double term_freq) {
+        ids.push_back(document_id);
+        term_freqs.push_back(term_freq);
+    });
+
+    runs_.clear();
+    run_posting_count_ = 0;
+    ids_.swap(ids);
+    term_freqs_.swap(term_freqs);
+    pending_ids_.clear();
+    pending_term_freqs_.clear();
+    UpdateMaxTermFreq();
+}
+
+std::vector<int> PostingList::GetSplitIds(size_t part_count) const {
+    // Pending postings are ignored, they only make the parts slightly uneven
+    std::vector<int> split_ids;
+    if (compressed_) {
+        // Parts start at block boundaries, right after the last id of the previous block
+        const size_t block_count = compressed_->BlockCount();
+        for (size_t part = 1; part < part_count; ++part) {
+            const size_t block = block_count * part / part_count;
+            if (block > 0 && (split_ids.empty() || split_ids.back() <= compressed_->BlockLastId(block - 1))) {
+                split_ids.push_back(compressed_->BlockLastId(block - 1) + 1);
+            }
+        }
+        return split_ids;
+    }
+    // Positions count through the runs and then the main arrays
+    const size_t main_size = run_posting_count_ + ids_.size();
+    size_t run_index = 0;
+    size_t run_start = 0;
+    for (size_t part = 1; part < part_count; ++part) {
+        const size_t pos = main_size * part / part_count;
+        if (pos == 0 || pos >= main_size) {
+            continue;
+        }
+        while (run_index < runs_.size() && run_start + runs_[run_index].size <= pos) {
+            run_start += runs_[run_index].size;
+            ++run_index;
+        }
+        const int split_id = run_index < runs_.size()
+            ? runs_[run_index].document_ids[pos - run_start]
+            : ids_[pos - run_start];
+        if (split_ids.empty() || split_ids.back() < split_id) {
+            split_ids.push_back(split_id);
+        }
+    }
+    return split_ids;
+}
+
+void PostingList::UpdateMaxTermFreq() {
+    max_term_freq_ = 0.0;
+    if (compressed_) {
+        ForEach([this](int, double term_freq) {
+            max_term_freq_ = std::max(max_term_freq_, term_freq);
+        });
+        return;
+    }
+    for (const RunView& run : runs_) {
+        max_term_freq_ = std::max(max_term_freq_, run.max_term_freq);
+    }
+    for (const double term_freq : term_freqs_) {
+        max_term_freq_ = std::max(max_term_freq_, term_freq);
+    }
+    for (const double term_freq : pending_term_freqs_) {
+        max_term_freq_ = std::max(max_term_freq_, term_freq);
+    }
+}
+
+void PostingList::RenumberRun(RunView& run, const std::vector<int>& new_ids) {
+    auto renumbered = std::make_shared<PostingRun>();
+    renumbered->document_ids.resize(run.size);
+    renumbered->term_freqs.resize(run.size);
+
+    int* ids = renumbered->document_ids.data();
+    double* term_freqs = renumbered->term_freqs.data();
+    double max_term_freq = 0.0;
+    size_t out = 0;
+    for (size_t pos = 0; pos < run.size; ++pos) {
+        const int new_id = new_ids[run.document_ids[pos]];
+        if (new_id < 0) {
+            continue;
+        }
+        ids[out] = new_id;
+        term_freqs[out] = run.term_freqs[pos];
+        max_term_freq = std::max(max_term_freq, term_freqs[out]);
+        ++out;
+    }
+    renumbered->document_ids.resize(out);
+    renumbered->term_freqs.resize(out);
+    run = { renumbered->document_ids.data(), renumbered->term_freqs.data(), out, max_term_freq, std::move(renumbered) };
+}
+
+PostingList::Cursor::Cursor(const PostingList& list)
+    : list_(&list) {
+    if (list.compressed_) {
+        has_block_ = true;
+        LoadBlock(0);
+    } else {
+        LoadRun(0);
+    }
+    SkipFinishedChunk();
+}
+
+PostingList::Cursor::Cursor(const Cursor& other) {
+    *this = other;
+}
+
+PostingList::Cursor& PostingList::Cursor::operator=(const Cursor& other) {
+    list_ = other.list_;
+    ids_ = other.ids_;
+    term_freqs_ = other.term_freqs_;
+    main_size_ = other.main_size_;
+    main_pos_ = other.main_pos_;
+    pending_pos_ = other.pending_pos_;
+    run_index_ = other.run_index_;
+    has_block_ = other.has_block_;
+    block_index_ = other.block_index_;
+    if (has_block_) {
+        // Only the decoded part of the block is meaningful
+        std::copy(other.block_.ids, other.block_.ids + main_size_, block_.ids);
+        std::copy(other.block_.term_freqs, other.block_.term_freqs + main_size_, block_.term_freqs);
+        ids_ = block_.ids;
+        term_freqs_ = block_.term_freqs;
+    }
+    return *this;
+}
+
+void PostingList::Cursor::LoadBlock(size_t block_index) {
+    const CompressedPostings& compressed = *list_->compressed_;
+    block_index_ = block_index;
+    main_pos_ = 0;
+    main_size_ = block_index < compressed.BlockCount()
+        ? compressed.DecodeBlock(block_index, block_.ids, block_.term_freqs)
+        : 0;
+    ids_ = block_.ids;
+    term_freqs_ = block_.term_freqs;
+}
+
+void PostingList::Cursor::LoadRun(size_t run_index) {
+    run_index_ = run_index;
+    main_pos_ = 0;
+    if (run_index < list_->runs_.size()) {
+        const RunView& run = list_->runs_[run_index];
+        ids_ = run.document_ids;
+        term_freqs_ = run.term_freqs;
+        main_size_ = run.size;
+    } else {
+        ids_ = list_->ids_.data();
+        term_freqs_ = list_->term_freqs_.data();
+        main_size_ = list_->ids_.size();
+    }
+}
+
+void PostingList::Cursor::NextChunk() {
+    if (has_block_) {
+        LoadBlock(block_index_ + 1);
+        return;
+    }
+    // Runs are never empty, so the next chunk has postings unless it is the last one
+    LoadRun(run_index_ + 1);
+}
+
+void PostingList::Cursor::SeekGE(int document_id) {
+    if (main_size_ > 0 && ids_[main_size_ - 1] < document_id && !IsLastChunk()) {
+        if (has_block_) {
+            // Blocks are skipped by their last ids without decoding them
+            LoadBlock(list_->compressed_->FindBlock(document_id));
+        } else {
+            // So are runs
+            const std::vector<RunView>& runs = list_->runs_;
+            size_t run_index = run_index_ + 1;
+            while (run_index < runs.size() && runs[run_index].LastId() < document_id) {
+                ++run_index;
+            }
+            LoadRun(run_index);
+        }
+    }
+    if (main_pos_ < main_size_ && ids_[main_pos_] < document_id) {
+        // Galloping search: the target is usually close to the current position
+        size_t step = 1;
+        size_t low = main_pos_;
+        size_t high = main_pos_ + 1;
+        while (high < main_size_ && ids_[high] < document_id) {
+            low = high;
+            step *= 2;
+            high = low + step;
+        }
+        high = std::min(high, main_size_);
+        main_pos_ = std::lower_bound(ids_ + low, ids_ + high, document_id) - ids_;
+    }
+    SkipFinishedChunk();
+
+    const std::vector<int>& pending_ids = list_->pending_ids_;
+    if (pending_pos_ < pending_ids.size() && pending_ids[pending_pos_] < document_id) {
+        pending_pos_ = std::distance(pending_ids.begin(),
+            std::lower_bound(pending_ids.begin() + pending_pos_, pending_ids.end(), document_id));
+    }
+}
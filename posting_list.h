@@ -0,0 +1,267 @@
+#pragma once
+
+#include "compressed_postings.h"
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Sealed postings of a list, sorted by document id and never changed. Runs are shared by copies
+// of the lists holding them and by merges built from them.
+struct PostingRun {
+    std::vector<int> document_ids;
+    std::vector<double> term_freqs;
+};
+
+// Posting list of a single term: (document id, term frequency) pairs sorted by document id.
+//
+// Postings live in contiguous arrays instead of tree nodes: a series of sealed read-only runs
+// followed by the main arrays (ids and frequencies). Ids greater than the last stored one are
+// appended to the main arrays in place, any other insert goes to a small sorted pending buffer
+// that is merged into the main arrays, runs included, once it outgrows a fraction of the list.
+// Postings are never removed one at a time: those of removed documents stay in the list until
+// the index is compacted, and Renumber drops them then, replacing every run it changes with a copy.
+//
+// Seal turns the main arrays into a new run, so that the bulk of a growing list is not copied
+// again, and ReplaceRuns puts a concatenation of adjacent runs, built by MergeRuns, in their place.
+// A run may also be borrowed from external storage, e.g. a mapped snapshot. The whole list may be
+// replaced with CompressedPostings by Compress; it is turned back into plain arrays on the first
+// change of the list.
+class PostingList {
+public:
+    class Cursor;
+
+    // Read-only postings of a run or of external storage
+    struct RunView {
+        const int* document_ids;
+        const double* term_freqs;
+        size_t size;
+        double max_term_freq;
+        // Owner of the arrays, null for external storage
+        std::shared_ptr<const PostingRun> run;
+
+        int FirstId() const {
+            return document_ids[0];
+        }
+
+        int LastId() const {
+            return document_ids[size - 1];
+        }
+    };
+
+    // The arrays must be sorted by id and outlive the list and its copies
+    static PostingList MakeExternal(const int* document_ids, const double* term_freqs, size_t count,
+        double max_term_freq);
+
+    // document_id must not be present in the list
+    void Add(int document_id, double term_freq);
+    // Adds count postings with ascending ids, none of them present in the list, in a single merge
+    void AddSorted(const int* document_ids, const double* term_freqs, size_t count);
+    // Replaces every id with new_ids[id] in a single pass, dropping the postings of ids mapped to -1.
+    // new_ids must number the kept ids densely in their order and cover every id of the list.
+    // Runs whose ids all stay the same are kept as they are.
+    void Renumber(const std::vector<int>& new_ids);
+
+    // Adds the postings of other with ids not less than first_id, lowering their ids by shift.
+    // The lowered ids must be greater than every id of the list.
+    void AppendShifted(const PostingList& other, int first_id, int shift);
+
+    bool Contains(int document_id) const;
+
+    // Number of live postings
+    size_t size() const {
+        return compressed_ ? compressed_->size()
+            : run_posting_count_ + ids_.size() + pending_ids_.size();
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    // Upper bound of term frequencies of the list
+    double MaxTermFreq() const {
+        return max_term_freq_;
+    }
+
+    // Calls func(document_id, term_freq) for every posting in ascending id order
+    template <typename Func>
+    void ForEach(Func func) const;
+
+    Cursor GetCursor() const;
+
+    // Up to part_count - 1 ascending ids splitting the list into parts of roughly equal size
+    std::vector<int> GetSplitIds(size_t part_count) const;
+
+    // Bytes held by the list including spare capacity, external arrays are not counted
+    size_t MemoryUsage() const;
+
+    // Replaces the postings with their compressed form, term frequencies are rounded
+    // as described in CompressedPostings
+    void Compress();
+
+    bool IsCompressed() const {
+        return compressed_ != nullptr;
+    }
+
+    // Moves the postings of the main arrays into a new run, unless the list is compressed or they
+    // are too few to be worth a run of their own
+    void Seal();
+
+    // Runs lying entirely within ids [first_id, last_id), in id order
+    std::vector<RunView> GetRuns(int first_id, int last_id) const;
+
+    // Concatenation of adjacent runs, the runs must not be empty
+    static RunView MergeRuns(const std::vector<RunView>& runs);
+
+    // Puts merged, built by MergeRuns from GetRuns(first_id, last_id), in place of the runs it was
+    // built from. Returns false and leaves the list alone if those runs have changed since.
+    bool ReplaceRuns(int first_id, int last_id, const RunView& merged);
+
+private:
+    static constexpr size_t MIN_PENDING_LIMIT = 32;
+    static constexpr size_t MIN_RUN_SIZE = 64;
+
+    std::vector<RunView> runs_;
+    size_t run_posting_count_ = 0;
+    std::vector<int> ids_;
+    std::vector<double> term_freqs_;
+    // Replaces all of the above while set, a compressed list has no pending postings.
+    // Copies of the list share it.
+    std::shared_ptr<const CompressedPostings> compressed_;
+    double max_term_freq_ = 0.0;
+
+    std::vector<int> pending_ids_;
+    std::vector<double> pending_term_freqs_;
+
+    // Greatest id of the runs and the main arrays, -1 if there are none
+    int LastId() const {
+        return !ids_.empty() ? ids_.back() : !runs_.empty() ? runs_.back().LastId() : -1;
+    }
+
+    // Copies compressed postings into the main arrays
+    void Materialize();
+    // Merges the pending postings and the runs into the main arrays
+    void MergePending();
+    void UpdateMaxTermFreq();
+
+    // Replaces the run with a renumbered copy as Renumber does. The run itself is never changed,
+    // other versions of the index and merges in progress may be reading it.
+    static void RenumberRun(RunView& run, const std::vector<int>& new_ids);
+};
+
+// Forward iterator over the postings of a list, the list must not change while it is used.
+// The runs and the main arrays are read chunk by chunk. Compressed lists are decoded block by block
+// into a buffer embedded in the cursor, so cursors never allocate and can be kept in reusable
+// containers.
+class PostingList::Cursor {
+public:
+    explicit Cursor(const PostingList& list);
+
+    Cursor(const Cursor& other);
+    Cursor& operator=(const Cursor& other);
+
+    bool AtEnd() const {
+        return main_pos_ == main_size_ && pending_pos_ == list_->pending_ids_.size();
+    }
+
+    // Cursor must not be at end
+    int DocumentId() const {
+        return IsMainCurrent() ? ids_[main_pos_] : list_->pending_ids_[pending_pos_];
+    }
+
+    double TermFreq() const {
+        return IsMainCurrent() ? term_freqs_[main_pos_] : list_->pending_term_freqs_[pending_pos_];
+    }
+
+    void Next() {
+        if (IsMainCurrent()) {
+            ++main_pos_;
+            SkipFinishedChunk();
+        } else {
+            ++pending_pos_;
+        }
+    }
+
+    // Moves to the first posting with id not less than document_id, never moves backwards
+    void SeekGE(int document_id);
+
+private:
+    struct DecodedBlock {
+        int ids[CompressedPostings::BLOCK_SIZE];
+        double term_freqs[CompressedPostings::BLOCK_SIZE];
+    };
+
+    const PostingList* list_;
+    // Current chunk: a run, the main arrays or the current block of a compressed list
+    const int* ids_ = nullptr;
+    const double* term_freqs_ = nullptr;
+    size_t main_size_ = 0;
+    size_t main_pos_ = 0;
+    size_t pending_pos_ = 0;
+    // Index of the current run, the number of runs for the main arrays
+    size_t run_index_ = 0;
+    // Only used for compressed lists, left uninitialized otherwise
+    bool has_block_ = false;
+    size_t block_index_ = 0;
+    DecodedBlock block_;
+
+    // Past the last block the cursor is at end
+    void LoadBlock(size_t block_index);
+    void LoadRun(size_t run_index);
+
+    bool IsLastChunk() const {
+        return has_block_ ? block_index_ + 1 >= list_->compressed_->BlockCount()
+            : run_index_ == list_->runs_.size();
+    }
+
+    // Moves from the end of a chunk but the last one to the start of the next one
+    void NextChunk();
+
+    bool IsMainCurrent() const {
+        return pending_pos_ == list_->pending_ids_.size()
+            || (main_pos_ < main_size_ && ids_[main_pos_] < list_->pending_ids_[pending_pos_]);
+    }
+
+    void SkipFinishedChunk() {
+        if (main_pos_ == main_size_ && !IsLastChunk()) {
+            NextChunk();
+        }
+    }
+};
+
+inline PostingList::Cursor PostingList::GetCursor() const {
+    return Cursor(*this);
+}
+
+template <typename Func>
+void PostingList::ForEach(Func func) const {
+    if (compressed_) {
+        int ids[CompressedPostings::BLOCK_SIZE];
+        double term_freqs[CompressedPostings::BLOCK_SIZE];
+        for (size_t block = 0; block < compressed_->BlockCount(); ++block) {
+            const size_t count = compressed_->DecodeBlock(block, ids, term_freqs);
+            for (size_t i = 0; i < count; ++i) {
+                func(ids[i], term_freqs[i]);
+            }
+        }
+        return;
+    }
+
+    // Pending postings are interleaved with the runs and the main arrays by id
+    size_t j = 0;
+    const size_t pending_size = pending_ids_.size();
+    auto visit = [this, &func, &j, pending_size](const int* ids, const double* term_freqs, size_t count) {
+        for (size_t i = 0; i < count; ++i) {
+            for (; j < pending_size && pending_ids_[j] < ids[i]; ++j) {
+                func(pending_ids_[j], pending_term_freqs_[j]);
+            }
+            func(ids[i], term_freqs[i]);
+        }
+    };
+    for (const RunView& run : runs_) {
+        visit(run.document_ids, run.term_freqs, run.size);
+    }
+    visit(ids_.data(), term_freqs_.data(), ids_.size());
+    for (; j < pending_size; ++j) {
+        func(pending_ids_[j], pending_term_freqs_[j]);
+    }
+}
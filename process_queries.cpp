@@ -1,25 +1,25 @@
-#include "process_queries.h"
-
-std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
-{
-	std::vector<std::vector<Document>> documents_lists(queries.size());
-	std::transform(
-		std::execution::par,
-		queries.cbegin(), queries.cend(),
-		documents_lists.begin(),
-		[&search_server](const std::string& query) { return search_server.FindTopDocuments(query); });
-	return documents_lists;
-}
-
-std::list<Document> ProcessQueriesJoined(const SearchServer& search_server, const std::vector<std::string>& queries)
-{
-    std::list<Document> documents;
-    for (const auto& docs : ProcessQueries(search_server, queries)) 
-    {
-        for (const auto& doc : docs) 
-        {
-            documents.push_back(doc);
-        }
-    } 
-    return documents;
-}
\ No newline at end of file
+#include "process_queries.h"
+
+std::vector<std::vector<Document>> ProcessQueries(const SearchServer& search_server, const std::vector<std::string>& queries)
+{
+	return search_server.FindTopDocumentsBatch(std::execution::par, queries);
+}
+
+bool JoinedQueryResults::MakeAvailable(size_t pos) const
+{
+    while (pos >= documents_.size() && processed_query_count_ < queries_.size())
+    {
+        const size_t chunk_size = std::min(CHUNK_SIZE, queries_.size() - processed_query_count_);
+        const auto first = queries_.begin() + processed_query_count_;
+        chunk_documents_.clear();
+        search_server_.FindTopDocumentsJoined(std::execution::par, first, first + chunk_size, chunk_documents_);
+        documents_.insert(documents_.end(), chunk_documents_.begin(), chunk_documents_.end());
+        processed_query_count_ += chunk_size;
+    }
+    return pos < documents_.size();
+}
+
+JoinedQueryResults ProcessQueriesJoined(const SearchServer& search_server, std::vector<std::string> queries)
+{
+    return JoinedQueryResults(search_server, std::move(queries));
+}
@@ -1,17 +1,121 @@
-#pragma once
-
-#include "search_server.h"
-#include <vector>
-#include <string>
-#include <execution>
-#include <algorithm>
-#include <list>
-#include <numeric>
-
-std::vector<std::vector<Document>> ProcessQueries(
-    const SearchServer& search_server,
-    const std::vector<std::string>& queries);
-
-std::list<Document> ProcessQueriesJoined(
-    const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+#pragma once
+
+#include "search_server.h"
+#include <vector>
+#include <string>
+#include <execution>
+#include <algorithm>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <utility>
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+// Results of a batch of queries joined in query order. Queries are evaluated chunk by chunk as
+// the range is iterated, and all results are kept, so the range may be traversed again. Results
+// are appended to a deque, which never moves them: references obtained from an iterator stay
+// valid while later chunks are evaluated. The range owns the queries, but only refers to the
+// server: the server must outlive the range and must not change while queries are left to evaluate.
+class JoinedQueryResults {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Document;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Document*;
+        using reference = const Document&;
+
+        Iterator() = default;
+
+        reference operator*() const {
+            return results_->documents_[pos_];
+        }
+
+        pointer operator->() const {
+            return &results_->documents_[pos_];
+        }
+
+        Iterator& operator++() {
+            ++pos_;
+            Normalize();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return pos_ == other.pos_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return pos_ != other.pos_;
+        }
+
+    private:
+        friend class JoinedQueryResults;
+
+        static constexpr size_t END = std::numeric_limits<size_t>::max();
+
+        const JoinedQueryResults* results_ = nullptr;
+        size_t pos_ = END;
+
+        Iterator(const JoinedQueryResults* results, size_t pos)
+            : results_(results)
+            , pos_(pos) {
+            Normalize();
+        }
+
+        // Evaluates further chunks if needed, a position past all results becomes END
+        void Normalize() {
+            if (pos_ != END && !results_->MakeAvailable(pos_)) {
+                pos_ = END;
+            }
+        }
+    };
+
+    JoinedQueryResults(const SearchServer& search_server, std::vector<std::string> queries)
+        : search_server_(search_server)
+        , queries_(std::move(queries)) {
+    }
+
+    Iterator begin() const {
+        return Iterator(this, 0);
+    }
+
+    Iterator end() const {
+        return Iterator();
+    }
+
+    // Evaluates all remaining queries
+    size_t size() const {
+        MakeAvailable(Iterator::END);
+        return documents_.size();
+    }
+
+private:
+    static constexpr size_t CHUNK_SIZE = 256;
+
+    const SearchServer& search_server_;
+    std::vector<std::string> queries_;
+    mutable std::deque<Document> documents_;
+    // Results of the chunk being evaluated, kept to reuse its capacity
+    mutable std::vector<Document> chunk_documents_;
+    mutable size_t processed_query_count_ = 0;
+
+    // Evaluates chunks until the result at pos exists or the queries run out, returns whether it exists
+    bool MakeAvailable(size_t pos) const;
+};
+
+// queries are copied, or moved from a temporary, into the result
+JoinedQueryResults ProcessQueriesJoined(
+    const SearchServer& search_server,
+    std::vector<std::string> queries);
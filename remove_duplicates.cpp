@@ -1,26 +1,302 @@
-#include "remove_duplicates.h"
-
-void RemoveDuplicates(SearchServer& search_server) {
-	std::vector<int> ids_for_remove;
-	std::set<std::set<std::string_view>> documents_words;
-
-	for (const int document_id : search_server) {
-		auto words = search_server.GetWordFrequencies(document_id);
-		std::set<std::string_view> document_words;
-		for (const auto& [word, freq] : words) {
-			document_words.insert(word);
-		}
-
-		if (documents_words.count(document_words) > 0) {
-			ids_for_remove.push_back(document_id);
-		}
-		else {
-			documents_words.insert(document_words);
-		}
-	}
-
-	for (const int id : ids_for_remove) {
-		std::cout << "Found duplicate document id " << id << std::endl;
-		search_server.RemoveDocument(id);
-	}
-}
\ No newline at end of file
+#include "remove_duplicates.h"
+
+#include <array>
+
+using namespace std::string_literals;
+
+namespace {
+
+// Order-independent 128-bit signature of a word set: the sum of two independent 64-bit
+// mixes of every word id. Equal sets have equal signatures, unequal ones rarely do.
+struct WordSetSignature {
+	uint64_t low = 0;
+	uint64_t high = 0;
+
+	bool operator<(const WordSetSignature& other) const {
+		return std::tie(low, high) < std::tie(other.low, other.high);
+	}
+
+	bool operator==(const WordSetSignature& other) const {
+		return low == other.low && high == other.high;
+	}
+};
+
+uint64_t Mix(uint64_t value) {
+	value ^= value >> 30;
+	value *= 0xbf58476d1ce4e5b9ULL;
+	value ^= value >> 27;
+	value *= 0x94d049bb133111ebULL;
+	value ^= value >> 31;
+	return value;
+}
+
+WordSetSignature ComputeSignature(const SearchServer& search_server, int document_id) {
+	WordSetSignature signature;
+	search_server.ForEachDocumentWordId(document_id, [&signature](uint64_t word_id) {
+		signature.low += Mix(word_id + 0x9e3779b97f4a7c15ULL);
+		signature.high += Mix(word_id ^ 0xd6e8feb86659fd93ULL);
+	});
+	return signature;
+}
+
+std::vector<uint64_t> GetWordIds(const SearchServer& search_server, int document_id) {
+	std::vector<uint64_t> word_ids;
+	search_server.ForEachDocumentWordId(document_id, [&word_ids](uint64_t word_id) { word_ids.push_back(word_id); });
+	return word_ids;
+}
+
+// Ids of the documents whose word set equals that of a document with a lower id, ascending
+std::vector<int> FindDuplicates(const SearchServer& search_server) {
+	struct SignedDocument {
+		WordSetSignature signature;
+		int id;
+	};
+
+	std::vector<SignedDocument> documents;
+	documents.reserve(search_server.GetDocumentCount());
+	for (const int document_id : search_server) {
+		documents.push_back({ {}, document_id });
+	}
+	std::for_each(std::execution::par, documents.begin(), documents.end(), [&search_server](SignedDocument& document) {
+		document.signature = ComputeSignature(search_server, document.id);
+	});
+	std::sort(std::execution::par, documents.begin(), documents.end(), [](const SignedDocument& lhs, const SignedDocument& rhs) {
+		return std::tie(lhs.signature, lhs.id) < std::tie(rhs.signature, rhs.id);
+	});
+
+	// Only documents of a group with equal signatures may be duplicates. Groups are compared
+	// word by word, so that a signature collision never removes a distinct document.
+	std::vector<int> duplicate_ids;
+	for (size_t first = 0; first < documents.size();) {
+		size_t last = first + 1;
+		while (last < documents.size() && documents[last].signature == documents[first].signature) {
+			++last;
+		}
+		if (last - first > 1) {
+			// Word sets seen in the group so far, each kept by the lowest id having it
+			std::vector<std::vector<uint64_t>> distinct_word_ids;
+			for (size_t i = first; i < last; ++i) {
+				std::vector<uint64_t> word_ids = GetWordIds(search_server, documents[i].id);
+				if (std::find(distinct_word_ids.begin(), distinct_word_ids.end(), word_ids) != distinct_word_ids.end()) {
+					duplicate_ids.push_back(documents[i].id);
+				}
+				else {
+					distinct_word_ids.push_back(std::move(word_ids));
+				}
+			}
+		}
+		first = last;
+	}
+	std::sort(duplicate_ids.begin(), duplicate_ids.end());
+	return duplicate_ids;
+}
+
+
+// Near-duplicates are found with MinHash: for each of MINHASH_COUNT hash functions a document
+// keeps the least hash of its words, and two documents agree on it with probability equal to
+// the Jaccard similarity of their word sets. The hashes are split into bands of rows; documents
+// agreeing on a whole band become candidates and are then compared exactly.
+constexpr int MINHASH_COUNT = 128;
+// Chance to find a pair of documents right at the similarity threshold
+constexpr double MIN_THRESHOLD_RECALL = 0.95;
+struct LshBands {
+	int band_count;
+	int row_count;
+};
+
+// The most selective banding still finding pairs at the threshold with MIN_THRESHOLD_RECALL
+LshBands ChooseBands(double similarity_threshold) {
+	for (int row_count = MINHASH_COUNT; row_count > 1; --row_count) {
+		const int band_count = MINHASH_COUNT / row_count;
+		const double recall = 1.0 - std::pow(1.0 - std::pow(similarity_threshold, row_count), band_count);
+		if (recall >= MIN_THRESHOLD_RECALL) {
+			return { band_count, row_count };
+		}
+	}
+	return { MINHASH_COUNT, 1 };
+}
+
+// Hash of the rows of a band: a combination of the least hashes of the document words
+uint64_t ComputeBandHash(const SearchServer& search_server, int document_id, int band, int row_count) {
+	std::array<uint64_t, MINHASH_COUNT> min_hashes;
+	std::fill(min_hashes.begin(), min_hashes.begin() + row_count, std::numeric_limits<uint64_t>::max());
+	search_server.ForEachDocumentWordId(document_id, [&min_hashes, band, row_count](uint64_t word_id) {
+		for (int row = 0; row < row_count; ++row) {
+			const uint64_t seed = 0x9e3779b97f4a7c15ULL * static_cast<uint64_t>(band * row_count + row + 1);
+			min_hashes[row] = std::min(min_hashes[row], Mix(word_id ^ seed));
+		}
+	});
+	uint64_t band_hash = Mix(static_cast<uint64_t>(band));
+	for (int row = 0; row < row_count; ++row) {
+		band_hash = Mix(band_hash ^ min_hashes[row]);
+	}
+	return band_hash;
+}
+
+// Exact Jaccard similarity of two ascending word id sequences, empty sets are equal
+double ComputeJaccard(const std::vector<uint64_t>& lhs, const std::vector<uint64_t>& rhs) {
+	size_t common_count = 0;
+	auto lhs_it = lhs.begin();
+	auto rhs_it = rhs.begin();
+	while (lhs_it != lhs.end() && rhs_it != rhs.end()) {
+		if (*lhs_it < *rhs_it) {
+			++lhs_it;
+		}
+		else if (*rhs_it < *lhs_it) {
+			++rhs_it;
+		}
+		else {
+			++common_count;
+			++lhs_it;
+			++rhs_it;
+		}
+	}
+	const size_t union_count = lhs.size() + rhs.size() - common_count;
+	return union_count == 0 ? 1.0 : static_cast<double>(common_count) / union_count;
+}
+
+size_t FindRoot(std::vector<size_t>& parents, size_t index) {
+	while (parents[index] != index) {
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+}
+
+void RemoveDuplicates(SearchServer& search_server) {
+	const std::vector<int> ids_for_remove = FindDuplicates(search_server);
+
+	for (const int id : ids_for_remove) {
+		std::cout << "Found duplicate document id " << id << std::endl;
+	}
+	search_server.RemoveDocuments(ids_for_remove);
+}
+
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, double similarity_threshold) {
+	if (!(similarity_threshold > 0.0 && similarity_threshold <= 1.0)) {
+		throw std::invalid_argument("similarity threshold must be in (0, 1]"s);
+	}
+	const LshBands bands = ChooseBands(similarity_threshold);
+	const std::vector<int> document_ids(search_server.begin(), search_server.end());
+	const size_t document_count = document_ids.size();
+
+	// Clusters are kept as a forest over document indexes, roots being the lowest indexes
+	std::vector<size_t> parents(document_count);
+	std::iota(parents.begin(), parents.end(), 0);
+
+	// Bands are processed one at a time, so memory stays linear in the number of documents
+	// whatever the number of bands
+	struct BandEntry {
+		uint64_t hash;
+		size_t index;
+	};
+	std::vector<BandEntry> entries(document_count);
+	// [first, last) ranges of entries with equal band hashes, those with a single entry skipped
+	std::vector<std::pair<size_t, size_t>> buckets;
+	// For every bucket pairs of indexes of similar documents, enough to connect its clusters
+	std::vector<std::vector<std::pair<size_t, size_t>>> bucket_links;
+	for (int band = 0; band < bands.band_count; ++band) {
+		std::for_each(std::execution::par, entries.begin(), entries.end(), [&](BandEntry& entry) {
+			entry.index = &entry - entries.data();
+			entry.hash = ComputeBandHash(search_server, document_ids[entry.index], band, bands.row_count);
+		});
+		std::sort(std::execution::par, entries.begin(), entries.end(), [](const BandEntry& lhs, const BandEntry& rhs) {
+			return std::tie(lhs.hash, lhs.index) < std::tie(rhs.hash, rhs.index);
+		});
+
+		buckets.clear();
+		for (size_t first = 0, last = 1; first < document_count; first = last++) {
+			while (last < document_count && entries[last].hash == entries[first].hash) {
+				++last;
+			}
+			if (last - first > 1) {
+				buckets.emplace_back(first, last);
+			}
+		}
+		bucket_links.assign(buckets.size(), {});
+
+		// Every member is compared with each earlier member not yet known to share its cluster,
+		// a forest local to the bucket tells which ones do. Buckets of equal documents thus cost
+		// a comparison per member, only dissimilar members sharing a band hash cost more.
+		std::for_each(std::execution::par, buckets.begin(), buckets.end(), [&](const std::pair<size_t, size_t>& bucket) {
+			const auto [first, last] = bucket;
+			std::vector<std::pair<size_t, size_t>>& links = bucket_links[&bucket - buckets.data()];
+			std::vector<std::vector<uint64_t>> word_ids;
+			word_ids.reserve(last - first);
+			std::vector<size_t> local_parents(last - first);
+			std::iota(local_parents.begin(), local_parents.end(), 0);
+			for (size_t i = 0; i < last - first; ++i) {
+				word_ids.push_back(GetWordIds(search_server, document_ids[entries[first + i].index]));
+				for (size_t j = 0; j < i; ++j) {
+					const size_t lhs_root = FindRoot(local_parents, j);
+					const size_t rhs_root = FindRoot(local_parents, i);
+					if (lhs_root != rhs_root && ComputeJaccard(word_ids[j], word_ids[i]) >= similarity_threshold) {
+						local_parents[std::max(lhs_root, rhs_root)] = std::min(lhs_root, rhs_root);
+						links.emplace_back(entries[first + j].index, entries[first + i].index);
+					}
+				}
+			}
+		});
+
+		for (const auto& links : bucket_links) {
+			for (const auto& [lhs, rhs] : links) {
+				const size_t lhs_root = FindRoot(parents, lhs);
+				const size_t rhs_root = FindRoot(parents, rhs);
+				parents[std::max(lhs_root, rhs_root)] = std::min(lhs_root, rhs_root);
+			}
+		}
+	}
+
+	// Every root with other members gives a cluster. Roots are numbered once all members are
+	// known, so clusters come in the order of their roots, which are their lowest ids.
+	std::vector<size_t> cluster_numbers(document_count, document_count);
+	for (size_t i = 0; i < document_count; ++i) {
+		const size_t root = FindRoot(parents, i);
+		if (root != i) {
+			cluster_numbers[root] = 0;
+		}
+	}
+	std::vector<std::vector<int>> clusters;
+	for (size_t i = 0; i < document_count; ++i) {
+		const size_t root = FindRoot(parents, i);
+		if (root == i) {
+			if (cluster_numbers[i] != document_count) {
+				cluster_numbers[i] = clusters.size();
+				clusters.push_back({ document_ids[i] });
+			}
+			continue;
+		}
+		clusters[cluster_numbers[root]].push_back(document_ids[i]);
+	}
+	return clusters;
+}
+
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold) {
+	std::vector<int> ids_for_remove;
+	for (const std::vector<int>& cluster : FindNearDuplicates(search_server, similarity_threshold)) {
+		// A cluster may chain documents far less similar than the threshold, so every member is
+		// checked against the members kept so far, the lowest id first
+		std::vector<std::vector<uint64_t>> kept_word_ids{ GetWordIds(search_server, cluster.front()) };
+		for (auto it = cluster.begin() + 1; it != cluster.end(); ++it) {
+			std::vector<uint64_t> word_ids = GetWordIds(search_server, *it);
+			const bool is_duplicate = std::any_of(kept_word_ids.begin(), kept_word_ids.end(),
+				[&word_ids, similarity_threshold](const std::vector<uint64_t>& kept) {
+					return ComputeJaccard(kept, word_ids) >= similarity_threshold;
+				});
+			if (is_duplicate) {
+				ids_for_remove.push_back(*it);
+			}
+			else {
+				kept_word_ids.push_back(std::move(word_ids));
+			}
+		}
+	}
+	std::sort(ids_for_remove.begin(), ids_for_remove.end());
+
+	for (const int id : ids_for_remove) {
+		std::cout << "Found near-duplicate document id " << id << '\n';
+	}
+	search_server.RemoveDocuments(ids_for_remove);
+}
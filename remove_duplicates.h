@@ -1,4 +1,17 @@
-#pragma once
-#include "search_server.h"
-
-void RemoveDuplicates(SearchServer& search_server);
+#pragma once
+#include "search_server.h"
+
+// Removes every document whose set of words equals that of a document with a lower id
+void RemoveDuplicates(SearchServer& search_server);
+
+// Clusters of documents whose word sets are similar: every member has Jaccard similarity of at
+// least similarity_threshold with another member. Clusters are closed under chaining, so two
+// members of a cluster may be much less similar than that. Candidates are found with MinHash
+// and LSH banding, so a similar pair is missed with a small probability, and are then checked
+// exactly. Ids are ascending within a cluster, clusters are ordered by their lowest id.
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, double similarity_threshold = 0.8);
+
+// Removes the documents of every cluster of FindNearDuplicates that have Jaccard similarity of at
+// least similarity_threshold with a member of lower id which is kept. The lowest id is always
+// kept, so is a member chained to it only through less similar documents.
+void RemoveNearDuplicates(SearchServer& search_server, double similarity_threshold = 0.8);
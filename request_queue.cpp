@@ -1,11 +1,133 @@
-#include "request_queue.h"
-
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    return AddFindRequest(
-        raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-            return document_status == status;
-        });
-}
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
-    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
-}
+#include "request_queue.h"
+
+#include <algorithm>
+#include <thread>
+
+RequestQueue::RequestQueue(const SearchServer& search_server, std::chrono::seconds window)
+    : search_server_(search_server)
+    , slot_duration_(std::max<Clock::duration>(Clock::duration(window) / SLOT_COUNT, Clock::duration(1)))
+    , slots_(std::make_unique<Slot[]>(SLOT_COUNT))
+    , recent_no_results_(std::make_unique<std::atomic<bool>[]>(MIN_IN_DAY)) {
+}
+
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
+    return AddFindRequest(raw_query, DocumentStatusIs{ status });
+}
+
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
+    return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
+}
+
+RequestStats RequestQueue::GetStats() const {
+    std::array<size_t, MAX_RESULT_DOCUMENT_COUNT + 1> result_counts{};
+    std::array<size_t, LATENCY_BUCKET_COUNT> latencies{};
+    const int64_t now = GetTick(Clock::now());
+    for (size_t i = 0; i < SLOT_COUNT; ++i) {
+        const Slot& slot = slots_[i];
+        const int64_t tick = slot.tick.load(std::memory_order_acquire);
+        if (tick < 0 || tick <= now - static_cast<int64_t>(SLOT_COUNT)) {
+            continue;
+        }
+        for (size_t j = 0; j < result_counts.size(); ++j) {
+            result_counts[j] += slot.result_counts[j].load(std::memory_order_relaxed);
+        }
+        for (size_t j = 0; j < latencies.size(); ++j) {
+            latencies[j] += slot.latencies[j].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Index of the bucket holding the request at the given fraction of the histogram
+    auto percentile = [](const auto& histogram, size_t total, double fraction) {
+        const size_t rank = static_cast<size_t>(fraction * (total - 1));
+        size_t count = 0;
+        for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+            count += histogram[bucket];
+            if (count > rank) {
+                return bucket;
+            }
+        }
+        return histogram.size() - 1;
+    };
+
+    RequestStats stats;
+    for (const size_t count : result_counts) {
+        stats.request_count += count;
+    }
+    if (stats.request_count == 0) {
+        return stats;
+    }
+    // Latencies are counted together with the results, so both histograms have about the same
+    // total, but a concurrent request may be counted in just one of them
+    size_t latency_total = 0;
+    for (const size_t count : latencies) {
+        latency_total += count;
+    }
+    stats.no_result_count = result_counts[0];
+    stats.result_count_p50 = percentile(result_counts, stats.request_count, 0.5);
+    stats.result_count_p99 = percentile(result_counts, stats.request_count, 0.99);
+    if (latency_total > 0) {
+        stats.latency_p50 = GetLatencyBucketLimit(percentile(latencies, latency_total, 0.5));
+        stats.latency_p99 = GetLatencyBucketLimit(percentile(latencies, latency_total, 0.99));
+    }
+    return stats;
+}
+
+size_t RequestQueue::GetLatencyBucket(std::chrono::nanoseconds latency) {
+    const uint64_t nanoseconds = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+    if (nanoseconds < 4) {
+        return nanoseconds;
+    }
+    const int exponent = 63 - __builtin_clzll(nanoseconds);
+    return exponent * 4 + ((nanoseconds >> (exponent - 2)) & 3);
+}
+
+std::chrono::nanoseconds RequestQueue::GetLatencyBucketLimit(size_t bucket) {
+    if (bucket < 4) {
+        return std::chrono::nanoseconds(bucket);
+    }
+    const size_t exponent = bucket / 4;
+    const uint64_t mantissa = 4 + bucket % 4;
+    // The largest latency of the bucket
+    return std::chrono::nanoseconds(static_cast<int64_t>(((mantissa + 1) << (exponent - 2)) - 1));
+}
+
+void RequestQueue::Record(Clock::time_point start_time, size_t result_count) {
+    const Clock::time_point end_time = Clock::now();
+
+    // The request takes the place of the one MIN_IN_DAY requests before it
+    const bool has_no_result = result_count == 0;
+    const uint64_t request_number = request_number_.fetch_add(1, std::memory_order_relaxed);
+    const bool had_no_result = recent_no_results_[request_number % MIN_IN_DAY].exchange(has_no_result, std::memory_order_relaxed);
+    no_result_count_.fetch_add(static_cast<int>(has_no_result) - static_cast<int>(had_no_result), std::memory_order_relaxed);
+
+    const int64_t tick = GetTick(end_time);
+    Slot& slot = slots_[tick % SLOT_COUNT];
+
+    // The first request of a new tick clears the counters of the tick the slot held before.
+    // Others arriving meanwhile wait for it, which happens once per slot and tick.
+    int64_t slot_tick = slot.tick.load(std::memory_order_acquire);
+    while (slot_tick != tick) {
+        if (slot_tick > tick) {
+            // The request took longer than the whole window, the slot has moved on
+            return;
+        }
+        if (slot_tick == CLEARING_TICK) {
+            std::this_thread::yield();
+            slot_tick = slot.tick.load(std::memory_order_acquire);
+            continue;
+        }
+        if (slot.tick.compare_exchange_weak(slot_tick, CLEARING_TICK, std::memory_order_acquire)) {
+            for (std::atomic<uint32_t>& count : slot.result_counts) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            for (std::atomic<uint32_t>& count : slot.latencies) {
+                count.store(0, std::memory_order_relaxed);
+            }
+            slot.tick.store(tick, std::memory_order_release);
+            slot_tick = tick;
+        }
+    }
+
+    slot.result_counts[std::min<size_t>(result_count, MAX_RESULT_DOCUMENT_COUNT)].fetch_add(1, std::memory_order_relaxed);
+    slot.latencies[GetLatencyBucket(end_time - start_time)].fetch_add(1, std::memory_order_relaxed);
+}
@@ -1,52 +1,94 @@
-#pragma once
-
-#include "search_server.h"
-#include <vector>
-#include <string>
-#include <deque>
-
-class RequestQueue {
-public:
-    explicit RequestQueue(const SearchServer& search_server) : search_server_(search_server),
-        current_time(0), no_answer_requests(0) {}
-
-    template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
-    std::vector<Document> AddFindRequest(const std::string& raw_query);
-
-    int GetNoResultRequests() const { return no_answer_requests; }
-
-private:
-    const SearchServer& search_server_;
-    struct QueryResult {
-        std::vector<Document> matched_documents;
-        int documents_count;
-    };
-    std::deque<QueryResult> requests_;
-    const static int min_in_day_ = 1440;
-    int current_time;
-    int no_answer_requests;
-};
-
-template <typename DocumentPredicate>
-std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    ++current_time;
-    if (current_time > min_in_day_)
-    {
-        if (requests_.front().documents_count == 0)
-        {
-            --no_answer_requests;
-        }
-        requests_.pop_front();
-    }
-    auto matched_documents = search_server_.FindTopDocuments(raw_query, document_predicate);
-
-    requests_.push_back({ matched_documents, static_cast<int>(matched_documents.size()) });
-    if (requests_.back().documents_count == 0)
-    {
-        ++no_answer_requests;
-    }
-
-    return matched_documents;
-}
+#pragma once
+
+#include "search_server.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <string>
+
+struct RequestStats {
+    size_t request_count = 0;
+    size_t no_result_count = 0;
+    // Percentiles of the number of documents found
+    size_t result_count_p50 = 0;
+    size_t result_count_p99 = 0;
+    // Percentiles of the search time, rounded up by at most a quarter
+    std::chrono::nanoseconds latency_p50{ 0 };
+    std::chrono::nanoseconds latency_p99{ 0 };
+};
+
+// Runs searches and keeps statistics of the requests of a sliding time window. Requests may be
+// added from any number of threads.
+//
+// The window is a ring of SLOT_COUNT slots, each counting the requests of window / SLOT_COUNT
+// of time in atomic counters and histograms, so the statistics cover between window minus one
+// slot and window of the latest time. A slot is cleared when the ring comes round to it again.
+// Searches do not touch the tracker, it is only updated after them.
+//
+// GetNoResultRequests keeps its original meaning and counts by requests rather than by time:
+// each request stands for a minute, and the last MIN_IN_DAY requests make up the day.
+class RequestQueue {
+public:
+    static constexpr size_t SLOT_COUNT = 64;
+    static constexpr size_t MIN_IN_DAY = 1440;
+
+    explicit RequestQueue(const SearchServer& search_server,
+        std::chrono::seconds window = std::chrono::hours(24));
+
+    template <typename DocumentPredicate>
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
+    std::vector<Document> AddFindRequest(const std::string& raw_query);
+
+    // Requests without results among the last MIN_IN_DAY requests. Requests are numbered as they
+    // finish, so with more than MIN_IN_DAY requests in flight at once the count is approximate.
+    int GetNoResultRequests() const {
+        return no_result_count_.load(std::memory_order_relaxed);
+    }
+
+    RequestStats GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    // Latencies are bucketed by their binary exponent and the two bits below the leading one
+    static constexpr size_t LATENCY_BUCKET_COUNT = 256;
+    static constexpr int64_t NO_TICK = -1;
+    static constexpr int64_t CLEARING_TICK = -2;
+
+    struct Slot {
+        // Time of the requests counted in the slot in units of slot_duration_
+        std::atomic<int64_t> tick = NO_TICK;
+        // Requests by the number of documents found
+        std::array<std::atomic<uint32_t>, MAX_RESULT_DOCUMENT_COUNT + 1> result_counts{};
+        std::array<std::atomic<uint32_t>, LATENCY_BUCKET_COUNT> latencies{};
+    };
+
+    const SearchServer& search_server_;
+    Clock::duration slot_duration_;
+    std::unique_ptr<Slot[]> slots_;
+    // Whether each of the last MIN_IN_DAY requests found nothing, by request number modulo MIN_IN_DAY
+    std::unique_ptr<std::atomic<bool>[]> recent_no_results_;
+    std::atomic<uint64_t> request_number_ = 0;
+    std::atomic<int> no_result_count_ = 0;
+
+    int64_t GetTick(Clock::time_point time) const {
+        return time.time_since_epoch() / slot_duration_;
+    }
+
+    static size_t GetLatencyBucket(std::chrono::nanoseconds latency);
+    static std::chrono::nanoseconds GetLatencyBucketLimit(size_t bucket);
+
+    void Record(Clock::time_point start_time, size_t result_count);
+};
+
+template <typename DocumentPredicate>
+std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
+    const Clock::time_point start_time = Clock::now();
+    std::vector<Document> matched_documents = search_server_.FindTopDocuments(raw_query, document_predicate);
+    Record(start_time, matched_documents.size());
+    return matched_documents;
+}
@@ -0,0 +1,88 @@
+#include "result_cache.h"
+
+ResultCache::ResultCache(const ResultCache& other) {
+    SetCapacity(other.shard_capacity_ * SHARD_COUNT);
+}
+
+ResultCache& ResultCache::operator=(const ResultCache& other) {
+    if (this != &other) {
+        SetCapacity(other.shard_capacity_ * SHARD_COUNT);
+        hit_count_ = 0;
+        miss_count_ = 0;
+    }
+    return *this;
+}
+
+void ResultCache::SetCapacity(size_t entry_count) {
+    shard_capacity_ = (entry_count + SHARD_COUNT - 1) / SHARD_COUNT;
+    for (Shard& shard : shards_) {
+        shard.entries.clear();
+        shard.entry_by_hash.clear();
+    }
+}
+
+bool ResultCache::Find(const Key& key, uint64_t epoch, std::vector<Document>& results) const {
+    const uint64_t hash = ComputeHash(key);
+    Shard& shard = GetShard(hash);
+    {
+        std::lock_guard guard(shard.mutex);
+        const auto it = shard.entry_by_hash.find(hash);
+        if (it != shard.entry_by_hash.end() && it->second->epoch == epoch && IsEntryOf(*it->second, key)) {
+            shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+            results = it->second->results;
+            hit_count_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    miss_count_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void ResultCache::Insert(const Key& key, uint64_t epoch, const std::vector<Document>& results) const {
+    const uint64_t hash = ComputeHash(key);
+    Shard& shard = GetShard(hash);
+    std::lock_guard guard(shard.mutex);
+    // Stale entries and entries of colliding keys are replaced
+    if (const auto it = shard.entry_by_hash.find(hash); it != shard.entry_by_hash.end()) {
+        shard.entries.erase(it->second);
+        shard.entry_by_hash.erase(it);
+    } else if (shard.entries.size() >= shard_capacity_) {
+        shard.entry_by_hash.erase(shard.entries.back().hash);
+        shard.entries.pop_back();
+    }
+    shard.entries.push_front({ hash, epoch, key.plus_terms, key.minus_terms, key.status, key.max_result_count, results });
+    shard.entry_by_hash[hash] = shard.entries.begin();
+}
+
+ResultCacheStats ResultCache::GetStats() const {
+    ResultCacheStats stats;
+    stats.hit_count = hit_count_.load(std::memory_order_relaxed);
+    stats.miss_count = miss_count_.load(std::memory_order_relaxed);
+    for (Shard& shard : shards_) {
+        std::lock_guard guard(shard.mutex);
+        stats.entry_count += shard.entries.size();
+    }
+    return stats;
+}
+
+uint64_t ResultCache::ComputeHash(const Key& key) {
+    uint64_t hash = static_cast<uint64_t>(key.status) * 0x9E3779B97F4A7C15ull + key.max_result_count;
+    const auto mix = [&hash](uint64_t value) {
+        hash = (hash ^ value) * 0xFF51AFD7ED558CCDull;
+        hash ^= hash >> 32;
+    };
+    for (const TermId term : key.plus_terms) {
+        mix(term);
+    }
+    // Separates plus terms from minus terms
+    mix(TermDictionary::NO_TERM);
+    for (const TermId term : key.minus_terms) {
+        mix(term);
+    }
+    return hash;
+}
+
+bool ResultCache::IsEntryOf(const Entry& entry, const Key& key) {
+    return entry.status == key.status && entry.max_result_count == key.max_result_count
+        && entry.plus_terms == key.plus_terms && entry.minus_terms == key.minus_terms;
+}
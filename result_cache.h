@@ -0,0 +1,90 @@
+#pragma once
+
+#include "document.h"
+#include "term_dictionary.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+struct ResultCacheStats {
+    size_t hit_count = 0;
+    size_t miss_count = 0;
+    size_t entry_count = 0;
+
+    double HitRate() const {
+        const size_t total = hit_count + miss_count;
+        return total == 0 ? 0.0 : static_cast<double>(hit_count) / total;
+    }
+};
+
+// Top documents of recently evaluated queries, keyed by the parsed query (sorted unique plus
+// and minus terms), the requested status and the result count. Each entry remembers the index
+// epoch it was computed for and is only returned for the same epoch, so any index change
+// invalidates all of them at once.
+//
+// The cache is split into independently locked shards, each evicting its least recently used
+// entry when full. Find and Insert may run concurrently with each other, but not with SetCapacity.
+class ResultCache {
+public:
+    struct Key {
+        const std::vector<TermId>& plus_terms;
+        const std::vector<TermId>& minus_terms;
+        DocumentStatus status;
+        size_t max_result_count;
+    };
+
+    ResultCache() = default;
+    // Copies the capacity, entries and statistics are not copied
+    ResultCache(const ResultCache& other);
+    ResultCache& operator=(const ResultCache& other);
+
+    // Keeps up to entry_count results, 0 disables the cache. Drops the current entries.
+    void SetCapacity(size_t entry_count);
+
+    bool IsEnabled() const {
+        return shard_capacity_ > 0;
+    }
+
+    // Copies the cached results of key to results and returns true if there are any for epoch
+    bool Find(const Key& key, uint64_t epoch, std::vector<Document>& results) const;
+
+    void Insert(const Key& key, uint64_t epoch, const std::vector<Document>& results) const;
+
+    ResultCacheStats GetStats() const;
+
+private:
+    static constexpr size_t SHARD_COUNT = 16;
+
+    struct Entry {
+        uint64_t hash;
+        uint64_t epoch;
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
+        DocumentStatus status;
+        size_t max_result_count;
+        std::vector<Document> results;
+    };
+
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        // Most recently used first
+        std::list<Entry> entries;
+        std::unordered_map<uint64_t, std::list<Entry>::iterator> entry_by_hash;
+    };
+
+    size_t shard_capacity_ = 0;
+    mutable std::array<Shard, SHARD_COUNT> shards_;
+    mutable std::atomic<size_t> hit_count_ = 0;
+    mutable std::atomic<size_t> miss_count_ = 0;
+
+    static uint64_t ComputeHash(const Key& key);
+    static bool IsEntryOf(const Entry& entry, const Key& key);
+
+    Shard& GetShard(uint64_t hash) const {
+        return shards_[hash % SHARD_COUNT];
+    }
+};
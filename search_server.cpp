@@ -1,183 +1,983 @@
-#include "search_server.h"
-
-using namespace std::string_literals;
-
-void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
-    const std::vector<int>& ratings) {
-    if (document_id < 0) {
-        throw std::invalid_argument("document_id must be positive"s);
-    }
-    if (!IsValidWord(document)) {
-        throw std::invalid_argument("invalid characters in document's text"s);
-    }
-    if (documents_.count(document_id) > 0) {
-        throw std::invalid_argument("this document_id already exists"s);
-    }
-
-    documents_texts_.push_back(std::string{document.begin(), document.end()});
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(documents_texts_.back());
-    const double inv_word_count = 1.0 / words.size();
-    for (const std::string_view word : words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        words_freqs_in_document[document_id][word] += inv_word_count;
-    }
-    documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
-    id_list_.insert(document_id);
-}
-
-void SearchServer::RemoveDocument(int document_id) {
-    //remove from documents_
-    documents_.erase(document_id);
-
-    //remove from word_to_document_freqs_
-    for (const auto& [word, id] : words_freqs_in_document.at(document_id))
-    {
-        word_to_document_freqs_.at(word).erase(document_id);
-    }
-
-    //remove from words_freqs_in_document
-    words_freqs_in_document.erase(document_id);
-
-    //remove from id_list_
-    id_list_.erase(document_id);
-}
-
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(std::execution::seq, raw_query, status);
-}
-
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
-    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
-}
-
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const
-{
-    const Query query = ParseQuery(raw_query);
-
-    std::vector<std::string_view> matched_words;
-
-    for (const std::string_view word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            return std::pair{ std::vector<std::string_view>{}, documents_.at(document_id).status };
-        }
-    }
-
-    for (const std::string_view word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
-        }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
-        }
-    }
-    
-    return std::pair{ matched_words, documents_.at(document_id).status };
-}
-
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const
-{
-    return MatchDocument(raw_query, document_id);
-}
-
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const
-{
-    const Query query = ParseQuery(std::execution::par, raw_query);
-
-    if (std::any_of(std::execution::par,
-        query.minus_words.cbegin(), query.minus_words.cend(),
-        [this, document_id](const auto& word) { return word_to_document_freqs_.at(word).count(document_id) > 0; }
-    )) {
-        return std::pair{ std::vector<std::string_view>{}, documents_.at(document_id).status };
-    }
-
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-
-    auto last = std::copy_if(std::execution::par,
-        query.plus_words.cbegin(), query.plus_words.cend(),
-        matched_words.begin(),
-        [this, document_id](const auto& word) { return word_to_document_freqs_.at(word).count(document_id) > 0; }
-    );
-    matched_words.erase(last, matched_words.end());
-    std::sort(std::execution::par, matched_words.begin(), matched_words.end());
-    matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
-
-    return std::pair{ matched_words, documents_.at(document_id).status };
-}
-
-bool SearchServer::IsValidWord(const std::string_view word) {
-    // A valid word must not contain special characters
-    return std::none_of(word.begin(), word.end(), [](char c) {
-        return c >= '\0' && c < ' ';
-        });
-}
-
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const {
-    std::vector<std::string_view> words;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
-    }
-    return words;
-}
-
-int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
-    if (ratings.empty()) {
-        return 0;
-    }
-    int rating_sum = std::accumulate(ratings.begin(), ratings.end(), 0);
-    return rating_sum / static_cast<int>(ratings.size());
-}
-
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
-    bool is_minus = false;
-    if (text[0] == '-') {
-        is_minus = true;
-        text = text.substr(1);
-    }
-    if (text[0] == '-' || text.empty()) {
-        throw std::invalid_argument("incorrect spelling of minus-words"s);
-    }
-    return { text, is_minus, IsStopWord(text) };
-}
-
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
-
-    auto query = ParseQuery(std::execution::par, text);
-
-    std::sort(query.minus_words.begin(), query.minus_words.end());
-    query.minus_words.erase(std::unique(query.minus_words.begin(), query.minus_words.end()), query.minus_words.end());
-    std::sort(query.plus_words.begin(), query.plus_words.end());
-    query.plus_words.erase(std::unique(query.plus_words.begin(), query.plus_words.end()), query.plus_words.end());
-
-    return query;
-}
-
-SearchServer::Query SearchServer::ParseQuery(const std::execution::parallel_policy policy, const std::string_view text) const {
-    if (!IsValidWord(text)) {
-        throw std::invalid_argument("invalid characters in query"s);
-    }
-    Query query;
-    for (const std::string_view word : SplitIntoWords(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
-            }
-            else {
-                query.plus_words.push_back(query_word.data);
-            }
-        }
-    }
-
-    return query;
-}
-
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static const std::map<std::string_view, double> dummy_map;
-    if (words_freqs_in_document.count(document_id) == 0) return dummy_map;
-    return words_freqs_in_document.at(document_id);
+#include "search_server.h"
+
+using namespace std::string_literals;
+
+SearchServer::SearchServer(std::shared_ptr<const IndexSnapshot> snapshot)
+    : SearchServer(snapshot->GetStopWords()) {
+    snapshot_ = std::move(snapshot);
+
+    std::vector<std::string_view> terms(snapshot_->TermCount());
+    term_postings_.reserve(terms.size());
+    for (TermId term = 0; term < terms.size(); ++term) {
+        terms[term] = snapshot_->GetTerm(term);
+        term_postings_.push_back(snapshot_->GetPostings(term));
+        posting_count_ += term_postings_.back().size();
+    }
+    terms_.AssignExternal(terms);
+    // A spelling stored twice keeps only one id in the dictionary
+    for (TermId term = 0; term < terms.size(); ++term) {
+        if (!terms[term].empty() && terms_.Find(terms[term]) != term) {
+            throw std::runtime_error("snapshot is malformed"s);
+        }
+    }
+    removed_posting_counts_.resize(terms_.size());
+    idf_cache_.Resize(terms_.size());
+    // The postings of the snapshot are a single sealed segment
+    if (snapshot_->DocumentCount() > 0) {
+        segments_.push_back({ 0, static_cast<int>(snapshot_->DocumentCount()), posting_count_ });
+    }
+
+    // Documents of the snapshot keep their numbers, the postings refer to them
+    document_columns_.Reserve(snapshot_->DocumentCount());
+    document_term_freqs_.resize(snapshot_->DocumentCount());
+    snapshot_rows_.resize(snapshot_->DocumentCount());
+    std::iota(snapshot_rows_.begin(), snapshot_rows_.end(), 0);
+    for (size_t i = 0; i < snapshot_->DocumentCount(); ++i) {
+        const int document_id = snapshot_->GetDocumentId(i);
+        const int document_number = document_columns_.Add(document_id, snapshot_->GetDocumentRating(i),
+            snapshot_->GetDocumentStatus(i));
+        if (!document_numbers_.emplace(document_id, document_number).second) {
+            throw std::runtime_error("snapshot is malformed"s);
+        }
+        id_list_.insert(document_id);
+    }
+}
+
+SearchServer SearchServer::OpenSnapshot(const std::string& path) {
+    return SearchServer(std::make_shared<const IndexSnapshot>(path));
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+    IndexSnapshotHeader header{};
+    header.stop_word_count = stop_words_.size();
+    for (const std::string& stop_word : stop_words_) {
+        header.stop_word_bytes += stop_word.size();
+    }
+    // Postings of removed documents are left out, and so are the words left without documents
+    auto get_term = [this](TermId term) {
+        return GetDocumentFreq(term) == 0 ? std::string_view() : terms_.GetTerm(term);
+    };
+    header.term_count = terms_.size();
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        header.term_bytes += get_term(term).size();
+        header.posting_count += GetDocumentFreq(term);
+    }
+    // Present documents are renumbered densely, keeping their order and so the order of the postings
+    std::vector<int> document_numbers;
+    std::vector<int> snapshot_numbers(document_columns_.size(), -1);
+    for (int document_number = 0; document_number < static_cast<int>(document_columns_.size()); ++document_number) {
+        if (document_columns_.IsLive(document_number)) {
+            snapshot_numbers[document_number] = static_cast<int>(document_numbers.size());
+            document_numbers.push_back(document_number);
+        }
+    }
+    header.document_count = document_numbers.size();
+    for (const int document_number : document_numbers) {
+        ForEachDocumentTerm(document_number, [&header](TermId, double) { ++header.document_term_count; });
+    }
+
+    IndexSnapshotWriter writer(path, header);
+    const IndexSnapshotLayout& layout = writer.GetLayout();
+
+    uint64_t offset = 0;
+    writer.StartArray(layout.stop_word_offsets);
+    writer.Write(offset);
+    for (const std::string& stop_word : stop_words_) {
+        writer.Write(offset += stop_word.size());
+    }
+    writer.StartArray(layout.stop_word_chars);
+    for (const std::string& stop_word : stop_words_) {
+        writer.WriteBytes(stop_word.data(), stop_word.size());
+    }
+
+    offset = 0;
+    writer.StartArray(layout.term_offsets);
+    writer.Write(offset);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        writer.Write(offset += get_term(term).size());
+    }
+    writer.StartArray(layout.term_chars);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        writer.WriteBytes(get_term(term).data(), get_term(term).size());
+    }
+
+    offset = 0;
+    writer.StartArray(layout.posting_offsets);
+    writer.Write(offset);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        writer.Write(offset += GetDocumentFreq(term));
+    }
+    writer.StartArray(layout.max_term_freqs);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        writer.Write(term_postings_[term].MaxTermFreq());
+    }
+    writer.StartArray(layout.posting_ids);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        term_postings_[term].ForEach([&writer, &snapshot_numbers](int document_number, double) {
+            if (snapshot_numbers[document_number] >= 0) {
+                writer.Write(snapshot_numbers[document_number]);
+            }
+        });
+    }
+    writer.StartArray(layout.posting_term_freqs);
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        term_postings_[term].ForEach([&writer, &snapshot_numbers](int document_number, double term_freq) {
+            if (snapshot_numbers[document_number] >= 0) {
+                writer.Write(term_freq);
+            }
+        });
+    }
+
+    writer.StartArray(layout.document_ids);
+    for (const int document_number : document_numbers) {
+        writer.Write(document_columns_.GetId(document_number));
+    }
+    writer.StartArray(layout.document_ratings);
+    for (const int document_number : document_numbers) {
+        writer.Write(document_columns_.GetRating(document_number));
+    }
+    writer.StartArray(layout.document_statuses);
+    for (const int document_number : document_numbers) {
+        writer.Write(static_cast<int>(document_columns_.GetStatus(document_number)));
+    }
+    offset = 0;
+    writer.StartArray(layout.document_term_offsets);
+    writer.Write(offset);
+    for (const int document_number : document_numbers) {
+        ForEachDocumentTerm(document_number, [&offset](TermId, double) { ++offset; });
+        writer.Write(offset);
+    }
+    writer.StartArray(layout.document_terms);
+    for (const int document_number : document_numbers) {
+        ForEachDocumentTerm(document_number, [&writer](TermId term, double) { writer.Write(term); });
+    }
+    writer.StartArray(layout.document_term_freqs);
+    for (const int document_number : document_numbers) {
+        ForEachDocumentTerm(document_number, [&writer](TermId, double term_freq) { writer.Write(term_freq); });
+    }
+
+    writer.Finish();
+}
+
+void SearchServer::AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+    const std::vector<int>& ratings) {
+    if (document_id < 0) {
+        throw std::invalid_argument("document_id must be positive"s);
+    }
+    std::vector<std::string_view> words;
+    if (!SplitIntoWordsNoStop(document, words)) {
+        throw std::invalid_argument("invalid characters in document's text"s);
+    }
+    if (document_numbers_.count(document_id) > 0) {
+        throw std::invalid_argument("this document_id already exists"s);
+    }
+
+    ++index_epoch_;
+    std::vector<TermId> document_terms(words.size());
+    std::transform(words.begin(), words.end(), document_terms.begin(),
+        [this](const std::string_view word) { return terms_.Intern(word); });
+    ResizeTermIndex();
+
+    const int document_number = document_columns_.Add(document_id, ComputeAverageRating(ratings), status);
+    const std::vector<TermFreq>& term_freqs = document_term_freqs_.emplace_back(ComputeTermFreqs(std::move(document_terms)));
+    for (const auto [term, term_freq] : term_freqs) {
+        term_postings_[term].Add(document_number, term_freq);
+    }
+    posting_count_ += term_freqs.size();
+    unsealed_posting_count_ += term_freqs.size();
+    document_numbers_.emplace(document_id, document_number);
+    id_list_.insert(document_id);
+    SealSegmentIfFull();
+}
+
+void SearchServer::AddDocumentBatch(const std::vector<DocumentToIndex>& documents, bool is_parallel) {
+    auto for_each_index = [is_parallel](size_t count, auto func) {
+        std::vector<size_t> indexes(count);
+        std::iota(indexes.begin(), indexes.end(), 0);
+        if (is_parallel) {
+            std::for_each(std::execution::par, indexes.begin(), indexes.end(), func);
+        } else {
+            std::for_each(indexes.begin(), indexes.end(), func);
+        }
+    };
+
+    // Every chunk tokenizes its documents into a local dictionary, checking their texts on the way.
+    // Local terms are registered globally chunk by chunk in order of first appearance, which
+    // assigns the same TermIds as adding the documents one by one.
+    struct IndexChunk {
+        size_t first_document;
+        size_t last_document;
+        std::unordered_map<std::string_view, uint32_t> local_ids;
+        std::vector<std::string_view> local_terms;
+        std::vector<std::vector<uint32_t>> document_words;
+        std::vector<TermId> global_ids;
+    };
+
+    constexpr size_t CHUNKS_PER_THREAD = 4;
+    const size_t chunk_count = std::max<size_t>(1, std::min(documents.size(),
+        is_parallel ? std::max(1u, std::thread::hardware_concurrency()) * CHUNKS_PER_THREAD : 1));
+    std::vector<IndexChunk> chunks(chunk_count);
+    std::vector<char> valid_texts(documents.size());
+    for_each_index(chunk_count, [&](size_t chunk_index) {
+        IndexChunk& chunk = chunks[chunk_index];
+        chunk.first_document = documents.size() * chunk_index / chunk_count;
+        chunk.last_document = documents.size() * (chunk_index + 1) / chunk_count;
+        std::vector<std::string_view> words;
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            valid_texts[i] = SplitIntoWordsNoStop(documents[i].text, words);
+            std::vector<uint32_t>& local_words = chunk.document_words.emplace_back();
+            for (const std::string_view word : words) {
+                const auto [it, inserted] = chunk.local_ids.emplace(word, static_cast<uint32_t>(chunk.local_terms.size()));
+                if (inserted) {
+                    chunk.local_terms.push_back(word);
+                }
+                local_words.push_back(it->second);
+            }
+        }
+    });
+
+    std::vector<int> batch_ids(documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        if (documents[i].id < 0) {
+            throw std::invalid_argument("document_id must be positive"s);
+        }
+        if (!valid_texts[i]) {
+            throw std::invalid_argument("invalid characters in document's text"s);
+        }
+        if (document_numbers_.count(documents[i].id) > 0) {
+            throw std::invalid_argument("this document_id already exists"s);
+        }
+        batch_ids[i] = documents[i].id;
+    }
+    std::sort(batch_ids.begin(), batch_ids.end());
+    if (std::adjacent_find(batch_ids.begin(), batch_ids.end()) != batch_ids.end()) {
+        throw std::invalid_argument("this document_id already exists"s);
+    }
+
+    ++index_epoch_;
+
+    for (IndexChunk& chunk : chunks) {
+        chunk.global_ids.reserve(chunk.local_terms.size());
+        for (const std::string_view term : chunk.local_terms) {
+            chunk.global_ids.push_back(terms_.Intern(term));
+        }
+    }
+    ResizeTermIndex();
+
+    std::vector<std::vector<TermFreq>> batch_term_freqs(documents.size());
+    for_each_index(chunk_count, [&](size_t chunk_index) {
+        IndexChunk& chunk = chunks[chunk_index];
+        for (size_t i = chunk.first_document; i < chunk.last_document; ++i) {
+            std::vector<uint32_t>& words = chunk.document_words[i - chunk.first_document];
+            std::vector<TermId> document_terms(words.size());
+            std::transform(words.begin(), words.end(), document_terms.begin(),
+                [&chunk](uint32_t local_id) { return chunk.global_ids[local_id]; });
+            batch_term_freqs[i] = ComputeTermFreqs(std::move(document_terms));
+            words = {};
+        }
+    });
+
+    // Postings of the batch grouped by term, then merged into every touched posting list at once.
+    // Documents are numbered in batch order, so the postings of every term come out sorted.
+    const int first_number = static_cast<int>(document_columns_.size());
+    std::vector<size_t> term_offsets(terms_.size() + 1);
+    for (const auto& term_freqs : batch_term_freqs) {
+        for (const TermFreq& term_freq : term_freqs) {
+            ++term_offsets[term_freq.term + 1];
+        }
+    }
+    std::partial_sum(term_offsets.begin(), term_offsets.end(), term_offsets.begin());
+    std::vector<int> posting_ids(term_offsets.back());
+    std::vector<double> posting_freqs(term_offsets.back());
+    std::vector<size_t> term_fill(term_offsets.begin(), term_offsets.end() - 1);
+    for (size_t i = 0; i < documents.size(); ++i) {
+        for (const TermFreq& term_freq : batch_term_freqs[i]) {
+            const size_t pos = term_fill[term_freq.term]++;
+            posting_ids[pos] = first_number + static_cast<int>(i);
+            posting_freqs[pos] = term_freq.freq;
+        }
+    }
+
+    std::vector<TermId> touched_terms;
+    for (TermId term = 0; term < terms_.size(); ++term) {
+        if (term_offsets[term + 1] > term_offsets[term]) {
+            touched_terms.push_back(term);
+        }
+    }
+    for_each_index(touched_terms.size(), [&](size_t i) {
+        const TermId term = touched_terms[i];
+        const size_t first = term_offsets[term];
+        const size_t count = term_offsets[term + 1] - first;
+        term_postings_[term].AddSorted(posting_ids.data() + first, posting_freqs.data() + first, count);
+    });
+    posting_count_ += posting_ids.size();
+    unsealed_posting_count_ += posting_ids.size();
+
+    document_columns_.Reserve(first_number + documents.size());
+    document_term_freqs_.reserve(first_number + documents.size());
+    for (size_t i = 0; i < documents.size(); ++i) {
+        const int document_number = document_columns_.Add(documents[i].id, documents[i].rating, documents[i].status);
+        document_term_freqs_.push_back(std::move(batch_term_freqs[i]));
+        document_numbers_.emplace(documents[i].id, document_number);
+        id_list_.insert(documents[i].id);
+    }
+    SealSegmentIfFull();
+}
+
+void SearchServer::RemoveDocument(int document_id) {
+    const auto it = document_numbers_.find(document_id);
+    if (it == document_numbers_.end()) {
+        throw std::out_of_range("document_id not found"s);
+    }
+    ++index_epoch_;
+    EraseDocumentRow(document_id, it->second);
+
+    if (compact_on_remove_ && NeedsCompaction()) {
+        CompactPostings();
+    }
+}
+
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    for (const int document_id : document_ids) {
+        if (document_numbers_.count(document_id) == 0) {
+            throw std::out_of_range("document_id not found"s);
+        }
+    }
+    ++index_epoch_;
+    for (const int document_id : document_ids) {
+        const auto it = document_numbers_.find(document_id);
+        if (it != document_numbers_.end()) {
+            EraseDocumentRow(document_id, it->second);
+        }
+    }
+
+    if (compact_on_remove_ && NeedsCompaction()) {
+        CompactPostings();
+    }
+}
+
+void SearchServer::CompactPostings() {
+    if (removed_document_numbers_.empty()) {
+        return;
+    }
+    Compaction compaction = MakeCompaction();
+    compaction.Build();
+    ApplyCompaction(compaction);
+}
+
+std::optional<SearchServer::Compaction> SearchServer::PrepareCompaction() const {
+    if (removed_document_numbers_.empty() || !NeedsCompaction()) {
+        return std::nullopt;
+    }
+    return MakeCompaction();
+}
+
+SearchServer::Compaction SearchServer::MakeCompaction() const {
+    Compaction compaction;
+    compaction.numbering_ = numbering_;
+
+    //number present documents densely in their order, so that the postings stay sorted
+    const int row_count = static_cast<int>(document_columns_.size());
+    compaction.end_number_ = row_count;
+    compaction.new_numbers_.resize(row_count);
+    compaction.first_numbers_.resize(row_count + 1);
+    for (int document_number = 0; document_number < row_count; ++document_number) {
+        const bool is_live = document_columns_.IsLive(document_number);
+        compaction.new_numbers_[document_number] = is_live ? compaction.first_numbers_[document_number] : -1;
+        compaction.first_numbers_[document_number + 1] = compaction.first_numbers_[document_number] + is_live;
+    }
+
+    compaction.removed_document_count_ = removed_document_numbers_.size();
+    compaction.removed_posting_counts_ = removed_posting_counts_;
+    compaction.removed_posting_count_ = removed_posting_count_;
+    //copies share the runs and the compressed postings, Build copies those it renumbers
+    compaction.postings_ = term_postings_;
+    compaction.snapshot_ = snapshot_;
+    return compaction;
+}
+
+void SearchServer::Compaction::Build() {
+    std::for_each(std::execution::par, postings_.begin(), postings_.end(),
+        [this](PostingList& postings) { postings.Renumber(new_numbers_); });
+}
+
+void SearchServer::ApplyCompaction(const Compaction& compaction) {
+    if (compaction.numbering_ != numbering_) {
+        return;
+    }
+    ++index_epoch_;
+    ++numbering_;
+
+    //rows added since the compaction was prepared move down by the rows it drops
+    const int end_number = compaction.end_number_;
+    const int shift = end_number - compaction.first_numbers_[end_number];
+    auto get_new_number = [&compaction, end_number, shift](int document_number) {
+        return document_number < end_number ? compaction.new_numbers_[document_number] : document_number - shift;
+    };
+    auto get_first_number = [&compaction, end_number, shift](int document_number) {
+        return document_number <= end_number ? compaction.first_numbers_[document_number] : document_number - shift;
+    };
+
+    //replace term_postings_ with the renumbered lists followed by the postings added since,
+    //every term owns a separate posting list
+    std::vector<TermId> terms(term_postings_.size());
+    std::iota(terms.begin(), terms.end(), 0);
+    std::for_each(std::execution::par, terms.begin(), terms.end(), [&](const TermId term) {
+        PostingList postings = term < compaction.postings_.size() ? compaction.postings_[term] : PostingList();
+        postings.AppendShifted(term_postings_[term], end_number, shift);
+        if (term_postings_[term].IsCompressed() && !postings.IsCompressed()) {
+            postings.Compress();
+        }
+        term_postings_[term] = std::move(postings);
+    });
+    for (TermId term = 0; term < compaction.removed_posting_counts_.size(); ++term) {
+        if (compaction.removed_posting_counts_[term] == 0) {
+            continue;
+        }
+        removed_posting_counts_[term] -= compaction.removed_posting_counts_[term];
+        if (term_postings_[term].empty()) {
+            terms_.Erase(term);
+        }
+    }
+    posting_count_ -= compaction.removed_posting_count_;
+    removed_posting_count_ -= compaction.removed_posting_count_;
+
+    //documents removed since the compaction was prepared keep their rows until the next one
+    removed_document_numbers_.erase(removed_document_numbers_.begin(),
+        removed_document_numbers_.begin() + compaction.removed_document_count_);
+    for (int& document_number : removed_document_numbers_) {
+        document_number = get_new_number(document_number);
+    }
+
+    //remove the rows of document_columns_, document_term_freqs_ and snapshot_rows_
+    document_columns_.DropRows([&get_new_number](int document_number) { return get_new_number(document_number) < 0; });
+    auto drop_rows = [&get_new_number, &get_first_number](auto& rows) {
+        for (size_t document_number = 0; document_number < rows.size(); ++document_number) {
+            const int new_number = get_new_number(static_cast<int>(document_number));
+            if (new_number >= 0 && static_cast<size_t>(new_number) != document_number) {
+                rows[new_number] = std::move(rows[document_number]);
+            }
+        }
+        rows.resize(get_first_number(static_cast<int>(rows.size())));
+    };
+    drop_rows(document_term_freqs_);
+    drop_rows(snapshot_rows_);
+    for (auto& [document_id, document_number] : document_numbers_) {
+        document_number = get_new_number(document_number);
+    }
+
+    //segments keep their postings, those left without documents are dropped
+    size_t out = 0;
+    for (const IndexSegment& segment : segments_) {
+        const int new_first_number = get_first_number(segment.first_number);
+        const int new_end_number = get_first_number(segment.end_number);
+        if (new_first_number < new_end_number) {
+            segments_[out++] = { new_first_number, new_end_number, segment.posting_count };
+        }
+    }
+    segments_.resize(out);
+}
+
+void SearchServer::EraseDocumentRow(int document_id, int document_number) {
+    //the postings are counted as removed until CompactPostings drops them
+    ForEachDocumentTerm(document_number, [this](TermId term, double) {
+        ++removed_posting_counts_[term];
+        ++removed_posting_count_;
+    });
+    removed_document_numbers_.push_back(document_number);
+
+    //remove from document_columns_, the row stays as a removed one
+    document_columns_.Remove(document_number);
+    document_numbers_.erase(document_id);
+
+    //remove from id_list_
+    id_list_.erase(document_id);
+}
+
+void SearchServer::ResizeTermIndex() {
+    if (term_postings_.size() < terms_.size()) {
+        term_postings_.resize(terms_.size());
+        removed_posting_counts_.resize(terms_.size());
+        idf_cache_.Resize(terms_.size());
+    }
+}
+
+void SearchServer::SealSegmentIfFull() {
+    if (unsealed_posting_count_ < SEGMENT_POSTING_COUNT) {
+        return;
+    }
+    // Lists with few postings in the mutable segment keep them in their main arrays
+    std::for_each(std::execution::par, term_postings_.begin(), term_postings_.end(),
+        [](PostingList& postings) { postings.Seal(); });
+    const int first_number = segments_.empty() ? 0 : segments_.back().end_number;
+    segments_.push_back({ first_number, static_cast<int>(document_columns_.size()), unsealed_posting_count_ });
+    unsealed_posting_count_ = 0;
+
+    if (merge_on_seal_) {
+        while (std::optional<SegmentMerge> merge = PrepareSegmentMerge()) {
+            merge->Build();
+            ApplySegmentMerge(*merge);
+        }
+    }
+}
+
+size_t SearchServer::GetSegmentTier(size_t posting_count) {
+    size_t tier = 0;
+    for (size_t limit = SEGMENT_POSTING_COUNT * MERGE_FACTOR; posting_count >= limit; limit *= MERGE_FACTOR) {
+        ++tier;
+    }
+    return tier;
+}
+
+std::optional<SearchServer::SegmentMerge> SearchServer::PrepareSegmentMerge() const {
+    // Segments are split into levels from the oldest one: a level reaches the last segment of the top
+    // tier among the segments left, so smaller segments sealed while merges lagged behind join the
+    // larger ones around them. The cheapest MERGE_FACTOR adjacent segments of a level are merged.
+    size_t merge_first = segments_.size();
+    for (size_t first = 0, end = 0; first < segments_.size() && merge_first == segments_.size(); first = end) {
+        size_t top_tier = 0;
+        for (size_t i = first; i < segments_.size(); ++i) {
+            const size_t tier = GetSegmentTier(segments_[i].posting_count);
+            if (tier >= top_tier) {
+                top_tier = tier;
+                end = i + 1;
+            }
+        }
+        size_t min_posting_count = std::numeric_limits<size_t>::max();
+        for (size_t i = first; i + MERGE_FACTOR <= end; ++i) {
+            size_t posting_count = 0;
+            for (size_t j = i; j < i + MERGE_FACTOR; ++j) {
+                posting_count += segments_[j].posting_count;
+            }
+            if (posting_count < min_posting_count) {
+                min_posting_count = posting_count;
+                merge_first = i;
+            }
+        }
+    }
+    if (merge_first == segments_.size()) {
+        return std::nullopt;
+    }
+
+    SegmentMerge merge;
+    merge.first_number_ = segments_[merge_first].first_number;
+    merge.end_number_ = segments_[merge_first + MERGE_FACTOR - 1].end_number;
+    merge.numbering_ = numbering_;
+    merge.snapshot_ = snapshot_;
+    std::vector<std::vector<PostingList::RunView>> term_runs(term_postings_.size());
+    std::transform(std::execution::par, term_postings_.begin(), term_postings_.end(), term_runs.begin(),
+        [&merge](const PostingList& postings) {
+            std::vector<PostingList::RunView> runs = postings.GetRuns(merge.first_number_, merge.end_number_);
+            if (runs.size() < 2) {
+                runs.clear();
+            }
+            return runs;
+        });
+    for (TermId term = 0; term < term_runs.size(); ++term) {
+        if (!term_runs[term].empty()) {
+            merge.terms_.push_back(term);
+            merge.runs_.push_back(std::move(term_runs[term]));
+        }
+    }
+    return merge;
+}
+
+void SearchServer::SegmentMerge::Build() {
+    merged_runs_.resize(runs_.size());
+    std::transform(std::execution::par, runs_.begin(), runs_.end(), merged_runs_.begin(), PostingList::MergeRuns);
+}
+
+void SearchServer::ApplySegmentMerge(const SegmentMerge& merge) {
+    if (merge.numbering_ != numbering_) {
+        return;
+    }
+    // Merged runs hold the same postings, so neither the epoch nor the caches change
+    for (size_t i = 0; i < merge.terms_.size(); ++i) {
+        const TermId term = merge.terms_[i];
+        if (term < term_postings_.size()) {
+            term_postings_[term].ReplaceRuns(merge.first_number_, merge.end_number_, merge.merged_runs_[i]);
+        }
+    }
+
+    // The segments may have been collapsed by CompressPostings meanwhile
+    const auto first = std::find_if(segments_.begin(), segments_.end(),
+        [&merge](const IndexSegment& segment) { return segment.first_number == merge.first_number_; });
+    const auto last = std::find_if(first, segments_.end(),
+        [&merge](const IndexSegment& segment) { return segment.end_number == merge.end_number_; });
+    if (last == segments_.end()) {
+        return;
+    }
+    size_t posting_count = 0;
+    for (auto it = first; it != last + 1; ++it) {
+        posting_count += it->posting_count;
+    }
+    *first = { merge.first_number_, merge.end_number_, posting_count };
+    segments_.erase(first + 1, last + 1);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_result_count);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query) const {
+    return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view raw_query, int document_id) const
+{
+    QueryContext& context = GetThreadQueryContext();
+    ParseQuery(raw_query, context.words, context.query);
+    const Query& query = context.query;
+    const int document_number = document_numbers_.at(document_id);
+    const DocumentStatus status = document_columns_.GetStatus(document_number);
+
+    std::vector<std::string_view> matched_words;
+
+    for (const TermId term : query.minus_terms) {
+        if (term_postings_[term].Contains(document_number)) {
+            return std::pair{ std::vector<std::string_view>{}, status };
+        }
+    }
+
+    // The result is the only allocation, so it is sized once and moved out
+    matched_words.reserve(query.plus_terms.size());
+    for (const TermId term : query.plus_terms) {
+        if (term_postings_[term].Contains(document_number)) {
+            matched_words.push_back(terms_.GetTerm(term));
+        }
+    }
+    std::sort(matched_words.begin(), matched_words.end());
+    
+    return std::pair{ std::move(matched_words), status };
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const
+{
+    return MatchDocument(raw_query, document_id);
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const
+{
+    const Query query = ParseQuery(std::execution::par, raw_query);
+    const int document_number = document_numbers_.at(document_id);
+    const DocumentStatus status = document_columns_.GetStatus(document_number);
+
+    if (std::any_of(std::execution::par,
+        query.minus_terms.cbegin(), query.minus_terms.cend(),
+        [this, document_number](const TermId term) { return term_postings_[term].Contains(document_number); }
+    )) {
+        return std::pair{ std::vector<std::string_view>{}, status };
+    }
+
+    std::vector<TermId> matched_terms(query.plus_terms.size());
+
+    auto last = std::copy_if(std::execution::par,
+        query.plus_terms.cbegin(), query.plus_terms.cend(),
+        matched_terms.begin(),
+        [this, document_number](const TermId term) { return term_postings_[term].Contains(document_number); }
+    );
+    std::vector<std::string_view> matched_words(std::distance(matched_terms.begin(), last));
+    std::transform(matched_terms.begin(), last, matched_words.begin(),
+        [this](const TermId term) { return terms_.GetTerm(term); });
+    std::sort(std::execution::par, matched_words.begin(), matched_words.end());
+    matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
+
+    return std::pair{ matched_words, status };
+}
+
+bool SearchServer::IsValidWord(const std::string_view word) {
+    // A valid word must not contain special characters
+    return std::none_of(word.begin(), word.end(), [](char c) {
+        return c >= '\0' && c < ' ';
+        });
+}
+
+bool SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const {
+    const bool is_valid = SplitIntoWords(text, words);
+    words.erase(std::remove_if(words.begin(), words.end(),
+        [this](const std::string_view word) { return IsStopWord(word); }), words.end());
+    return is_valid;
+}
+
+int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
+    if (ratings.empty()) {
+        return 0;
+    }
+    int rating_sum = std::accumulate(ratings.begin(), ratings.end(), 0);
+    return rating_sum / static_cast<int>(ratings.size());
+}
+
+std::vector<SearchServer::TermFreq> SearchServer::ComputeTermFreqs(std::vector<TermId> document_terms) {
+    std::sort(document_terms.begin(), document_terms.end());
+
+    // Accumulated word by word, as the frequencies have always been computed
+    const double inv_word_count = 1.0 / document_terms.size();
+    std::vector<TermFreq> term_freqs;
+    for (const TermId term : document_terms) {
+        if (term_freqs.empty() || term_freqs.back().term != term) {
+            term_freqs.push_back({ term, 0.0 });
+        }
+        term_freqs.back().freq += inv_word_count;
+    }
+    return term_freqs;
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
+    bool is_minus = false;
+    if (text[0] == '-') {
+        is_minus = true;
+        text = text.substr(1);
+    }
+    if (text[0] == '-' || text.empty()) {
+        throw std::invalid_argument("incorrect spelling of minus-words"s);
+    }
+    return { text, is_minus, IsStopWord(text) };
+}
+
+SearchServer::Query SearchServer::ParseQuery(const std::string_view text) const {
+    std::vector<std::string_view> words;
+    Query query;
+    ParseQuery(text, words, query);
+    return query;
+}
+
+SearchServer::Query SearchServer::ParseQuery(const std::execution::parallel_policy policy, const std::string_view text) const {
+    std::vector<std::string_view> words;
+    Query query;
+    ParseQueryTerms(text, words, query);
+    return query;
+}
+
+void SearchServer::ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& query) const {
+    ParseQueryTerms(text, words, query);
+
+    std::sort(query.minus_terms.begin(), query.minus_terms.end());
+    query.minus_terms.erase(std::unique(query.minus_terms.begin(), query.minus_terms.end()), query.minus_terms.end());
+    std::sort(query.plus_terms.begin(), query.plus_terms.end());
+    query.plus_terms.erase(std::unique(query.plus_terms.begin(), query.plus_terms.end()), query.plus_terms.end());
+}
+
+void SearchServer::ParseQueryTerms(const std::string_view text, std::vector<std::string_view>& words, Query& query) const {
+    if (!SplitIntoWords(text, words)) {
+        throw std::invalid_argument("invalid characters in query"s);
+    }
+    query.plus_terms.clear();
+    query.minus_terms.clear();
+    for (const std::string_view word : words) {
+        const QueryWord query_word = ParseQueryWord(word);
+        if (query_word.is_stop) {
+            continue;
+        }
+        const TermId term = terms_.Find(query_word.data);
+        if (term == TermDictionary::NO_TERM || GetDocumentFreq(term) == 0) {
+            continue;
+        }
+        if (query_word.is_minus) {
+            query.minus_terms.push_back(term);
+        }
+        else {
+            query.plus_terms.push_back(term);
+        }
+    }
+}
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_freqs;
+    const auto it = document_numbers_.find(document_id);
+    if (it == document_numbers_.end()) {
+        return word_freqs;
+    }
+    ForEachDocumentTerm(it->second, [this, &word_freqs](TermId term, double term_freq) {
+        word_freqs.emplace(terms_.GetTerm(term), term_freq);
+    });
+    return word_freqs;
+}
+
+IndexMemoryStats SearchServer::GetIndexMemoryStats() const {
+    IndexMemoryStats stats;
+    for (const PostingList& postings : term_postings_) {
+        stats.posting_count += postings.size();
+        stats.posting_bytes += postings.MemoryUsage();
+    }
+    stats.text_bytes = terms_.TextMemoryUsage();
+    stats.snapshot_bytes = snapshot_ ? snapshot_->FileSize() : 0;
+    stats.segment_count = segments_.size();
+    stats.document_row_count = document_columns_.size();
+    return stats;
+}
+
+void SearchServer::CompressPostings() {
+    // Rounded term frequencies change relevances slightly, cached results must not outlive them
+    ++index_epoch_;
+    std::for_each(std::execution::par, term_postings_.begin(), term_postings_.end(),
+        [](PostingList& postings) { postings.Compress(); });
+    // Compressed lists have no runs left to merge
+    segments_.clear();
+    if (document_columns_.size() > 0) {
+        segments_.push_back({ 0, static_cast<int>(document_columns_.size()), posting_count_ });
+    }
+    unsealed_posting_count_ = 0;
+}
+
+PruningStats SearchServer::GetPruningStats() const {
+    return { pruning_counters_.query_count.load(), pruning_counters_.posting_count.load(),
+        pruning_counters_.skipped_posting_count.load() };
+}
+
+SearchServer::ScoreWindow& SearchServer::GetThreadScoreWindow() {
+    thread_local ScoreWindow window;
+    return window;
+}
+
+SearchServer::QueryContext& SearchServer::GetThreadQueryContext() {
+    thread_local QueryContext context;
+    return context;
+}
+
+std::vector<std::vector<size_t>> SearchServer::GroupBatchQueries(const std::vector<Query>& queries) const {
+    constexpr size_t GROUP_SIZE = 32;
+
+    // Queries are ordered by their most expensive word, so the queries reading the longest
+    // posting lists tend to land in one group
+    std::vector<std::pair<TermId, size_t>> keyed_queries(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        TermId key = TermDictionary::NO_TERM;
+        for (const TermId term : queries[i].plus_terms) {
+            if (key == TermDictionary::NO_TERM || term_postings_[term].size() > term_postings_[key].size()) {
+                key = term;
+            }
+        }
+        keyed_queries[i] = { key, i };
+    }
+    std::sort(keyed_queries.begin(), keyed_queries.end());
+
+    std::vector<std::vector<size_t>> groups;
+    for (size_t i = 0; i < keyed_queries.size(); ++i) {
+        if (i % GROUP_SIZE == 0) {
+            groups.emplace_back();
+        }
+        groups.back().push_back(keyed_queries[i].second);
+    }
+    return groups;
+}
+
+void SearchServer::FindTopDocumentsForGroup(const std::vector<Query>& queries, const std::vector<size_t>& group,
+    DocumentStatus status, size_t max_result_count, Document* slots, size_t* result_counts) const {
+    constexpr int64_t WINDOW_SIZE = 4096;
+    constexpr size_t WINDOW_WORDS = WINDOW_SIZE / 64;
+
+    struct GroupTerm {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        // Positions in group of the queries using the term
+        std::vector<size_t> plus_queries;
+        std::vector<size_t> minus_queries;
+    };
+
+    struct TermUse {
+        TermId term;
+        size_t query;
+        bool is_minus;
+
+        bool operator<(const TermUse& other) const {
+            return std::tie(term, query) < std::tie(other.term, other.query);
+        }
+    };
+
+    std::vector<TermUse> term_uses;
+    for (size_t i = 0; i < group.size(); ++i) {
+        for (const TermId term : queries[group[i]].plus_terms) {
+            term_uses.push_back({ term, i, false });
+        }
+        for (const TermId term : queries[group[i]].minus_terms) {
+            term_uses.push_back({ term, i, true });
+        }
+    }
+    std::sort(term_uses.begin(), term_uses.end());
+
+    // Terms go in ascending TermId order, the order of plus_terms of every query, so each query
+    // sums its relevances exactly as FindAllDocuments does
+    std::vector<GroupTerm> group_terms;
+    for (size_t i = 0; i < term_uses.size(); ++i) {
+        const TermId term = term_uses[i].term;
+        if (term_postings_[term].empty()) {
+            continue;
+        }
+        if (i == 0 || term_uses[i - 1].term != term) {
+            group_terms.push_back({ term_postings_[term].GetCursor(), 0.0, {}, {} });
+        }
+        if (term_uses[i].is_minus) {
+            group_terms.back().minus_queries.push_back(term_uses[i].query);
+        } else {
+            group_terms.back().plus_queries.push_back(term_uses[i].query);
+            group_terms.back().inverse_document_freq = ComputeTermInverseDocumentFreq(term);
+        }
+    }
+
+    std::vector<double> relevances(group.size() * WINDOW_SIZE);
+    std::vector<uint64_t> matched(group.size() * WINDOW_WORDS);
+    std::vector<uint64_t> excluded(group.size() * WINDOW_WORDS);
+    std::vector<TopDocumentsCollector> collectors(group.size(), TopDocumentsCollector(max_result_count));
+    const uint64_t* status_bits = document_columns_.GetStatusBits(status);
+    const size_t status_word_count = (document_columns_.size() + 63) / 64;
+
+    while (true) {
+        int64_t window_begin = std::numeric_limits<int64_t>::max();
+        for (const GroupTerm& group_term : group_terms) {
+            if (!group_term.plus_queries.empty() && !group_term.cursor.AtEnd()) {
+                window_begin = std::min<int64_t>(window_begin, group_term.cursor.DocumentId());
+            }
+        }
+        if (window_begin == std::numeric_limits<int64_t>::max()) {
+            break;
+        }
+        // Aligned with the words of the status bitmap, which has no words past the last document
+        window_begin -= window_begin % 64;
+        const int64_t window_end = window_begin + WINDOW_SIZE;
+        const uint64_t* window_status_bits = status_bits + window_begin / 64;
+        const size_t window_words = std::min(WINDOW_WORDS, status_word_count - static_cast<size_t>(window_begin / 64));
+
+        for (GroupTerm& group_term : group_terms) {
+            PostingList::Cursor& cursor = group_term.cursor;
+            for (cursor.SeekGE(static_cast<int>(window_begin)); !cursor.AtEnd() && cursor.DocumentId() < window_end; cursor.Next()) {
+                const size_t pos = static_cast<size_t>(cursor.DocumentId() - window_begin);
+                const uint64_t bit = uint64_t{ 1 } << (pos % 64);
+                const double relevance = cursor.TermFreq() * group_term.inverse_document_freq;
+                for (const size_t query : group_term.plus_queries) {
+                    uint64_t& matched_word = matched[query * WINDOW_WORDS + pos / 64];
+                    double& query_relevance = relevances[query * WINDOW_SIZE + pos];
+                    if ((matched_word & bit) == 0) {
+                        matched_word |= bit;
+                        query_relevance = 0.0;
+                    }
+                    query_relevance += relevance;
+                }
+                for (const size_t query : group_term.minus_queries) {
+                    excluded[query * WINDOW_WORDS + pos / 64] |= bit;
+                }
+            }
+        }
+
+        for (size_t query = 0; query < group.size(); ++query) {
+            // Words past the last document have no postings, so they are left clear
+            for (size_t word = 0; word < window_words; ++word) {
+                uint64_t& matched_word = matched[query * WINDOW_WORDS + word];
+                uint64_t& excluded_word = excluded[query * WINDOW_WORDS + word];
+                for (uint64_t bits = matched_word & ~excluded_word & window_status_bits[word]; bits != 0; bits &= bits - 1) {
+                    const size_t pos = word * 64 + __builtin_ctzll(bits);
+                    const int document_number = static_cast<int>(window_begin + pos);
+                    collectors[query].Add({ document_columns_.GetId(document_number),
+                        relevances[query * WINDOW_SIZE + pos], document_columns_.GetRating(document_number) });
+                }
+                matched_word = 0;
+                excluded_word = 0;
+            }
+        }
+    }
+
+    for (size_t query = 0; query < group.size(); ++query) {
+        Document* query_slots = slots + group[query] * max_result_count;
+        result_counts[group[query]] = collectors[query].ExtractTo(query_slots) - query_slots;
+    }
 }
\ No newline at end of file
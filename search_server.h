@@ -1,284 +1,953 @@
-#pragma once
-
-#include "document.h"
-#include "string_processing.h"
-#include "concurrent_map.h"
-#include <string>
-#include <string_view>
-#include <vector>
-#include <deque>
-#include <set>
-#include <map>
-#include <tuple>
-#include <utility>
-#include <iostream>
-#include <algorithm>
-#include <numeric>
-#include <cmath>
-#include <stdexcept>
-#include <execution>
-#include <type_traits>
-
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
-constexpr double DELTA = 1e-6;
-
-class SearchServer {
-public:
-    // Defines an invalid document id
-    // You can refer to this constant as SearchServer::INVALID_DOCUMENT_ID
-    inline static constexpr int INVALID_DOCUMENT_ID = -1;
-
-    template <typename StringContainer>
-    explicit SearchServer(const StringContainer& stop_words);
-
-    explicit SearchServer(const std::string& stop_words_text)
-        : SearchServer(std::string_view(stop_words_text)) {} // delegating constructor for string_view constructor
-    explicit SearchServer(const std::string_view stop_words_text)
-        : SearchServer(SplitIntoWords(stop_words_text)) {} // Invoke delegating constructor from string container
-
-    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
-        const std::vector<int>& ratings);
-
-    template <class ExecutionPolicy>
-    void RemoveDocument(ExecutionPolicy&& policy, int document_id);
-    void RemoveDocument(int document_id);
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status) const;
-    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
-
-    template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
-        DocumentPredicate document_predicate) const;
-
-    template <class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query, DocumentStatus status) const;
-
-    template <class ExecutionPolicy>
-    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query) const;
-
-    int GetDocumentCount() const {
-        return static_cast<int>(documents_.size());
-    }
-
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const;
-    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const;
-
-    const auto begin() const {
-        return id_list_.begin();
-    }
-
-    const auto end() const {
-        return id_list_.end();
-    }
-
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
-
-private:
-    struct DocumentData {
-        int rating;
-        DocumentStatus status;
-    };
-
-    std::set<int> id_list_;
-    const std::set<std::string, std::less<>> stop_words_;
-    std::deque<std::string> documents_texts_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, std::map<std::string_view, double>> words_freqs_in_document;
-    std::map<int, DocumentData> documents_;
-
-    static bool IsValidWord(const std::string_view word);
-
-    bool IsStopWord(const std::string_view word) const {
-        return stop_words_.count(word) > 0;
-    }
-
-    std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
-
-    static int ComputeAverageRating(const std::vector<int>& ratings);
-
-    struct QueryWord {
-        std::string_view data;
-        bool is_minus;
-        bool is_stop;
-    };
-
-    QueryWord ParseQueryWord(std::string_view text) const;
-
-    struct Query {
-        std::vector<std::string_view> plus_words;
-        std::vector<std::string_view> minus_words;
-    };
-
-    Query ParseQuery(const std::string_view text) const;
-    Query ParseQuery(const std::execution::parallel_policy policy, const std::string_view text) const;
-
-    // Existence required
-    double ComputeWordInverseDocumentFreq(const std::string_view word) const {
-        return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
-    }
-
-    template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
-        DocumentPredicate document_predicate) const;
-
-    template <typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(const std::execution::parallel_policy policy, const Query& query,
-        DocumentPredicate document_predicate) const;
-};
-
-template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
-    using namespace std::string_literals;
-    if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
-        throw std::invalid_argument("invalid characters in stop_words"s);
-    }
-}
-
-template <class ExecutionPolicy>
-void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
-    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
-        RemoveDocument(document_id);
-    } else {
-        //remove from documents_
-        documents_.erase(document_id);
-
-        //remove from word_to_document_freqs_
-        if (words_freqs_in_document.count(document_id) > 0) {
-            std::map<std::string_view, double>& words_freqs = words_freqs_in_document.at(document_id);
-            std::vector<std::string_view*> words_to_delete(words_freqs.size());
-            std::transform(policy,
-                words_freqs.cbegin(), words_freqs.cend(),
-                words_to_delete.begin(),
-                [](const auto& word) { return const_cast<std::string_view*>(&word.first); });
-            std::for_each(policy,
-                words_to_delete.cbegin(), words_to_delete.cend(),
-                [this, document_id](const auto& word) { word_to_document_freqs_.at(*word).erase(document_id); }
-            );
-        }
-
-        //remove from words_freqs_in_document
-        words_freqs_in_document.erase(document_id);
-
-        //remove from id_list_
-        id_list_.erase(document_id);
-    } 
-}
-
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
-}
-
-template <class ExecutionPolicy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-    auto matched_documents = FindAllDocuments(policy, ParseQuery(raw_query), document_predicate);
-    std::sort(policy, matched_documents.begin(), matched_documents.end(),
-        [](const Document& lhs, const Document& rhs) {
-            if (std::abs(lhs.relevance - rhs.relevance) < DELTA) {
-                return lhs.rating > rhs.rating;
-            }
-            return lhs.relevance > rhs.relevance;
-        });
-
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
-    }
-    return matched_documents;
-}
-
-template <class ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query, DocumentStatus status) const {
-    return FindTopDocuments(
-        policy, raw_query, [status](int document_id, DocumentStatus document_status,
-            int rating) {
-                return document_status == status;
-        });
-}
-
-template <class ExecutionPolicy>
-std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query) const {
-    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
-}
-
-template <class ExecutionPolicy, typename DocumentPredicate>
-    std::vector<Document> SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query,
-                                      DocumentPredicate document_predicate) const {
-        std::map<int, double> document_to_relevance;
-        for (const std::string_view word : query.plus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-            for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                const auto& document_data = documents_.at(document_id);
-                if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                    document_to_relevance[document_id] += term_freq * inverse_document_freq;
-                }
-            }
-        }
-        for (const std::string_view word : query.minus_words) {
-            if (word_to_document_freqs_.count(word) == 0) {
-                continue;
-            }
-            for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                document_to_relevance.erase(document_id);
-            }
-        }
- 
-        std::vector<Document> matched_documents;
-
-        for (const auto [document_id, relevance] : document_to_relevance) {
-            matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
-        }
-        return matched_documents;
-    }
-
-    template <typename DocumentPredicate>
-    std::vector<Document> SearchServer::FindAllDocuments(const std::execution::parallel_policy policy, const Query& query,
-        DocumentPredicate document_predicate) const {
-        constexpr size_t THREAD_COUNT = 64;
-        ConcurrentMap<int, double> doc_to_rel_cm(THREAD_COUNT);
-
-        auto PlusWordFreqs = [&](const std::string_view word) {
-                if (word_to_document_freqs_.count(word) == 0) {
-                    return;
-                }
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-
-                for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                    if (document_predicate(document_id, documents_.at(document_id).status, documents_.at(document_id).rating)) {
-                        doc_to_rel_cm[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
-        };
-
-        std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), PlusWordFreqs);
-
-        std::for_each(policy, query.minus_words.cbegin(), query.minus_words.cend(),
-            [&](const std::string_view word) {
-                if (word_to_document_freqs_.count(word) != 0) {
-                    for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-                        doc_to_rel_cm.Erase(document_id);
-                    }
-                }
-            }
-        );
-
-        std::map<int, double> document_to_relevance = doc_to_rel_cm.BuildOrdinaryMap();
-
-        std::vector<Document> matched_documents(document_to_relevance.size());
-        std::transform(policy, 
-            document_to_relevance.cbegin(), document_to_relevance.cend(),
-            matched_documents.begin(),
-            [this](const auto& doc) { return Document{ doc.first, doc.second, documents_.at(doc.first).rating }; });
-
-        return matched_documents;
-    }
+#pragma once
+
+#include "document.h"
+#include "document_columns.h"
+#include "document_filters.h"
+#include "string_processing.h"
+#include "posting_list.h"
+#include "term_dictionary.h"
+#include "top_documents.h"
+#include "idf_cache.h"
+#include "result_cache.h"
+#include "index_snapshot.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <map>
+#include <tuple>
+#include <utility>
+#include <iostream>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <stdexcept>
+#include <execution>
+#include <type_traits>
+#include <atomic>
+#include <limits>
+#include <thread>
+#include <cstdint>
+#include <memory>
+#include <optional>
+
+const int MAX_RESULT_DOCUMENT_COUNT = 5;
+
+enum class QueryEvaluation {
+    // Scores every posting of every plus word
+    EXHAUSTIVE,
+    // Skips documents whose score upper bound cannot reach the current top, same results as EXHAUSTIVE
+    MAX_SCORE,
+};
+
+struct PruningStats {
+    size_t query_count = 0;
+    // Postings of the plus words of the evaluated queries
+    size_t posting_count = 0;
+    size_t skipped_posting_count = 0;
+};
+
+struct IndexMemoryStats {
+    size_t posting_count = 0;
+    size_t posting_bytes = 0;
+    // Bytes held by the spellings of indexed words
+    size_t text_bytes = 0;
+    // Size of the mapped snapshot the server was opened from, its postings are not counted above
+    size_t snapshot_bytes = 0;
+    // Sealed segments, see SearchServer::PrepareSegmentMerge
+    size_t segment_count = 0;
+    // Rows of document attributes, those of removed documents not compacted yet included
+    size_t document_row_count = 0;
+
+    double BytesPerPosting() const {
+        return posting_count == 0 ? 0.0 : static_cast<double>(posting_bytes) / posting_count;
+    }
+};
+
+class SearchServer {
+public:
+    // Defines an invalid document id
+    // You can refer to this constant as SearchServer::INVALID_DOCUMENT_ID
+    inline static constexpr int INVALID_DOCUMENT_ID = -1;
+
+    template <typename StringContainer>
+    explicit SearchServer(const StringContainer& stop_words);
+
+    explicit SearchServer(const std::string& stop_words_text)
+        : SearchServer(std::string_view(stop_words_text)) {} // delegating constructor for string_view constructor
+    explicit SearchServer(const std::string_view stop_words_text)
+        : SearchServer(SplitIntoWords(stop_words_text)) {} // Invoke delegating constructor from string container
+
+    // Opens a file written by SaveSnapshot. The file is mapped and queries read the index from
+    // the mapped pages; documents added or removed afterwards only affect the opened server.
+    // Opening checks the whole file and builds the id lookups of the documents, so it takes time
+    // linear in the file size even though later queries read only the pages they need.
+    // Throws std::runtime_error if the file is not an intact snapshot.
+    static SearchServer OpenSnapshot(const std::string& path);
+
+    // Writes path + ".tmp" and renames it to path, so the server may save over the snapshot it
+    // was opened from. Throws std::runtime_error if the file cannot be written.
+    void SaveSnapshot(const std::string& path) const;
+
+    void AddDocument(int document_id, const std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    // Adds a range of (id, text, status, ratings) items, e.g. tuples or aggregates, tokenizing and
+    // indexing them in parallel with the par policy. Items are checked as in AddDocument before any
+    // of them is added, so an invalid item leaves the server unchanged.
+    template <typename DocumentRange>
+    void AddDocuments(const DocumentRange& documents);
+    template <class ExecutionPolicy, typename DocumentRange>
+    void AddDocuments(ExecutionPolicy&& policy, const DocumentRange& documents);
+
+    // Removal only marks the document as removed, queries skip it by the live bitmap. Its postings,
+    // its row and the words left without documents are dropped by a compaction, which removals
+    // run on their own once removed documents make up an eighth of all postings or of all rows.
+    template <class ExecutionPolicy>
+    void RemoveDocument(ExecutionPolicy&& policy, int document_id);
+    void RemoveDocument(int document_id);
+    // Throws std::out_of_range before any change if an id is not present
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Drops the postings and rows of removed documents and forgets the words left without
+    // documents, see Compaction
+    void CompactPostings();
+
+    // max_result_count limits the number of returned documents, MAX_RESULT_DOCUMENT_COUNT by default
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+    std::vector<Document> FindTopDocuments(const std::string_view raw_query) const;
+
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
+        DocumentPredicate document_predicate, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query, DocumentStatus status,
+        size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    template <class ExecutionPolicy>
+    std::vector<Document> FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query) const;
+
+    // Evaluates many queries together: queries of a group share a single scan of every posting list
+    // they use. Result i equals FindTopDocuments(raw_queries[i], status, max_result_count).
+    template <class ExecutionPolicy, typename QueryContainer>
+    std::vector<std::vector<Document>> FindTopDocumentsBatch(ExecutionPolicy&& policy, const QueryContainer& raw_queries,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    // Evaluates queries [first, last) like FindTopDocumentsBatch and appends their results
+    // to joined_results in query order, without a separate container per query
+    template <class ExecutionPolicy, typename QueryIt>
+    void FindTopDocumentsJoined(ExecutionPolicy&& policy, QueryIt first, QueryIt last, std::vector<Document>& joined_results,
+        DocumentStatus status = DocumentStatus::ACTUAL, size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+    int GetDocumentCount() const {
+        return static_cast<int>(document_numbers_.size());
+    }
+
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::sequenced_policy policy, const std::string_view raw_query, int document_id) const;
+    std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::execution::parallel_policy policy, const std::string_view raw_query, int document_id) const;
+
+    const auto begin() const {
+        return id_list_.begin();
+    }
+
+    const auto end() const {
+        return id_list_.end();
+    }
+
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Calls func(word_id) for every distinct word of a present document in ascending id order.
+    // Word ids stay the same until the server changes, so documents with equal word sets give
+    // equal sequences. Throws std::out_of_range if the document is not present.
+    template <typename Func>
+    void ForEachDocumentWordId(int document_id, Func func) const;
+
+    // Memory held by the inverted index posting lists
+    IndexMemoryStats GetIndexMemoryStats() const;
+
+    // Compresses every posting list, see CompressedPostings for the precision of the relevances.
+    // Lists changed by later AddDocument or RemoveDocument calls are stored uncompressed again.
+    void CompressPostings();
+
+    // Postings of consecutive document numbers make up a segment. New documents go to the mutable
+    // tail segment; once it holds SEGMENT_POSTING_COUNT postings it is sealed: every posting list
+    // with more than a handful of tail postings moves them into a read-only run. Adjacent sealed
+    // segments of similar sizes are merged MERGE_FACTOR at a time by concatenating the runs of every
+    // list, so lists consist of a few large runs and sealing never copies older postings. Queries
+    // read the runs of a list as a single sequence and skip removed documents until a compaction
+    // renumbers the runs, so document frequencies, scores and deletes stay global across segments.
+    //
+    // A merge is prepared from the server, built without touching it, then applied to the server
+    // or to any other server with the same postings. Lists changed since the merge was prepared
+    // keep their runs.
+    class SegmentMerge {
+    public:
+        // Concatenates the runs, in parallel across the lists
+        void Build();
+
+    private:
+        friend class SearchServer;
+
+        int first_number_ = 0;
+        int end_number_ = 0;
+        std::vector<TermId> terms_;
+        std::vector<std::vector<PostingList::RunView>> runs_;
+        std::vector<PostingList::RunView> merged_runs_;
+        // Numbering of the documents the merge was prepared with
+        uint64_t numbering_ = 0;
+        // Keeps the runs borrowed from the mapped snapshot alive
+        std::shared_ptr<const IndexSnapshot> snapshot_;
+    };
+
+    // Returns the next merge chosen by the tiered policy, if any
+    std::optional<SegmentMerge> PrepareSegmentMerge() const;
+    // merge must be built. A merge prepared before the documents were renumbered is dropped.
+    void ApplySegmentMerge(const SegmentMerge& merge);
+
+    // By default sealing runs the merges right away. Servers merging in the background, see
+    // ConcurrentSearchServer, turn that off and merge with the calls above.
+    void SetMergeOnSeal(bool merge_on_seal) {
+        merge_on_seal_ = merge_on_seal;
+    }
+
+    // A compaction renumbers the present documents densely in their order, so that the rows of
+    // removed ones are reused and the postings stay sorted. Every posting list is renumbered in
+    // a single pass, runs below the first removed document are kept as they are.
+    //
+    // Like a merge, a compaction is prepared from the server, built without touching it, then
+    // applied to the server or to any other server with the same documents. Documents added or
+    // removed since it was prepared are carried over.
+    class Compaction {
+    public:
+        // Renumbers the posting lists, in parallel across the lists
+        void Build();
+
+    private:
+        friend class SearchServer;
+
+        uint64_t numbering_ = 0;
+        // Rows the compaction was prepared with, later ones are only moved down by the rows dropped
+        int end_number_ = 0;
+        // New numbers of the rows, -1 for those dropped
+        std::vector<int> new_numbers_;
+        // New number of the first row kept at or after every row, end_number_ + 1 of them
+        std::vector<int> first_numbers_;
+        // Removed documents and their postings dropped by the compaction
+        size_t removed_document_count_ = 0;
+        std::vector<uint32_t> removed_posting_counts_;
+        size_t removed_posting_count_ = 0;
+        // Copies of the posting lists, renumbered by Build
+        std::vector<PostingList> postings_;
+        // Keeps the runs borrowed from the mapped snapshot alive
+        std::shared_ptr<const IndexSnapshot> snapshot_;
+    };
+
+    // Returns a compaction once removed documents make up an eighth of all postings or of all rows
+    std::optional<Compaction> PrepareCompaction() const;
+    // compaction must be built. A compaction prepared before the documents were renumbered is
+    // dropped.
+    void ApplyCompaction(const Compaction& compaction);
+
+    // By default removals run the compaction right away. Servers compacting in the background,
+    // see ConcurrentSearchServer, turn that off and compact with the calls above.
+    void SetCompactOnRemove(bool compact_on_remove) {
+        compact_on_remove_ = compact_on_remove;
+    }
+
+    void SetQueryEvaluation(QueryEvaluation query_evaluation) {
+        query_evaluation_ = query_evaluation;
+    }
+
+    // Totals of the queries evaluated with QueryEvaluation::MAX_SCORE
+    PruningStats GetPruningStats() const;
+
+    IdfCacheStats GetIdfCacheStats() const {
+        return idf_cache_.GetStats();
+    }
+
+    // Caches results of up to entry_count distinct queries searched by status, 0 (the default)
+    // disables the cache. Queries with other predicates are always evaluated.
+    void SetResultCacheCapacity(size_t entry_count) {
+        result_cache_.SetCapacity(entry_count);
+    }
+
+    ResultCacheStats GetResultCacheStats() const {
+        return result_cache_.GetStats();
+    }
+
+private:
+    struct TermFreq {
+        TermId term;
+        double freq;
+    };
+
+    // Keeps the mapped arrays borrowed by the index alive
+    std::shared_ptr<const IndexSnapshot> snapshot_;
+    std::set<int> id_list_;
+    const std::set<std::string, std::less<>> stop_words_;
+    TermDictionary terms_;
+    // Inverted index, indexed by TermId. Postings refer to documents by their internal numbers,
+    // so the hot loops read document attributes from document_columns_ by index.
+    std::vector<PostingList> term_postings_;
+    // Forward index indexed by document number, terms of every document sorted by TermId.
+    // Rows of the documents of the snapshot are empty, their terms are read from snapshot_.
+    std::vector<std::vector<TermFreq>> document_term_freqs_;
+    // Row of snapshot_ of every document numbered below its size, the documents of the snapshot
+    // come first
+    std::vector<int> snapshot_rows_;
+    // Numbers of the present documents by id
+    std::map<int, int> document_numbers_;
+    DocumentColumns document_columns_;
+
+    // Removed documents whose postings are still in term_postings_, and the number of such
+    // postings by TermId. Scoring skips them by the live bitmap, document frequencies subtract them.
+    std::vector<int> removed_document_numbers_;
+    std::vector<uint32_t> removed_posting_counts_;
+    size_t removed_posting_count_ = 0;
+    // Postings in term_postings_, those of removed documents included
+    size_t posting_count_ = 0;
+    // Advanced by every renumbering of the documents
+    uint64_t numbering_ = 0;
+
+    static constexpr size_t SEGMENT_POSTING_COUNT = 1 << 18;
+    static constexpr size_t MERGE_FACTOR = 4;
+
+    // Sealed segment of documents numbered in [first_number, end_number), the mutable one follows
+    // the last of them
+    struct IndexSegment {
+        int first_number;
+        int end_number;
+        // Postings the segment was sealed with, summed by merges. Removals do not lower it,
+        // so the size tier of a segment stays put.
+        size_t posting_count;
+    };
+
+    std::vector<IndexSegment> segments_;
+    size_t unsealed_posting_count_ = 0;
+    bool merge_on_seal_ = true;
+    bool compact_on_remove_ = true;
+
+    struct PruningCounters {
+        std::atomic<size_t> query_count = 0;
+        std::atomic<size_t> posting_count = 0;
+        std::atomic<size_t> skipped_posting_count = 0;
+
+        PruningCounters() = default;
+        PruningCounters(const PruningCounters& other)
+            : query_count(other.query_count.load())
+            , posting_count(other.posting_count.load())
+            , skipped_posting_count(other.skipped_posting_count.load()) {
+        }
+    };
+
+    // Advanced by every change of the index
+    uint64_t index_epoch_ = 1;
+    IdfCache idf_cache_;
+    ResultCache result_cache_;
+
+    QueryEvaluation query_evaluation_ = QueryEvaluation::EXHAUSTIVE;
+    mutable PruningCounters pruning_counters_;
+
+    explicit SearchServer(std::shared_ptr<const IndexSnapshot> snapshot);
+
+    static bool IsValidWord(const std::string_view word);
+
+    bool IsStopWord(const std::string_view word) const {
+        return stop_words_.count(word) > 0;
+    }
+
+    // Stores the words of text except stop words into words, returns false if the text has invalid characters
+    bool SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
+
+    static int ComputeAverageRating(const std::vector<int>& ratings);
+
+    // Term frequencies of a document given the TermIds of its words
+    static std::vector<TermFreq> ComputeTermFreqs(std::vector<TermId> document_terms);
+
+    struct DocumentToIndex {
+        int id;
+        std::string_view text;
+        DocumentStatus status;
+        int rating;
+    };
+
+    void AddDocumentBatch(const std::vector<DocumentToIndex>& documents, bool is_parallel);
+
+    // Calls func(term, term_freq) for every term of a present document in ascending TermId order
+    template <typename Func>
+    void ForEachDocumentTerm(int document_number, Func func) const;
+
+    // Grows the per-term structures to the size of the dictionary
+    void ResizeTermIndex();
+
+    // Seals the mutable segment once it is full
+    void SealSegmentIfFull();
+
+    // Size tier of a segment, segments of a tier hold up to MERGE_FACTOR times more postings
+    // than those of the previous one
+    static size_t GetSegmentTier(size_t posting_count);
+
+    // Marks the document as removed, leaving its postings, row and terms to CompactPostings
+    void EraseDocumentRow(int document_id, int document_number);
+
+    bool NeedsCompaction() const {
+        return removed_posting_count_ > posting_count_ / 8
+            || removed_document_numbers_.size() > document_columns_.size() / 8;
+    }
+
+    // Compaction of all removed documents, to be built
+    Compaction MakeCompaction() const;
+
+    // Number of present documents containing the term
+    size_t GetDocumentFreq(TermId term) const {
+        return term_postings_[term].size() - removed_posting_counts_[term];
+    }
+
+    struct QueryWord {
+        std::string_view data;
+        bool is_minus;
+        bool is_stop;
+    };
+
+    QueryWord ParseQueryWord(std::string_view text) const;
+
+    // Words unknown to the index are dropped
+    struct Query {
+        std::vector<TermId> plus_terms;
+        std::vector<TermId> minus_terms;
+    };
+
+    Query ParseQuery(const std::string_view text) const;
+    Query ParseQuery(const std::execution::parallel_policy policy, const std::string_view text) const;
+    // Same as ParseQuery(text), writing into reusable buffers: words receives the split text
+    void ParseQuery(const std::string_view text, std::vector<std::string_view>& words, Query& query) const;
+    // Unsorted terms of the query in text order
+    void ParseQueryTerms(const std::string_view text, std::vector<std::string_view>& words, Query& query) const;
+
+    double ComputeTermInverseDocumentFreq(TermId term) const {
+        return idf_cache_.Get(term, index_epoch_, [this, term]() {
+            return std::log(GetDocumentCount() * 1.0 / GetDocumentFreq(term));
+        });
+    }
+
+    // Replaces the contents of matched_documents with all documents matching the query
+    template <class ExecutionPolicy, typename DocumentPredicate>
+    void FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+        std::vector<Document>& matched_documents) const;
+
+    template <typename DocumentPredicate>
+    void FindAllDocuments(const std::execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate,
+        std::vector<Document>& matched_documents) const;
+
+    // Filtering with a predicate takes two steps. Matches are first checked 64 at a time against
+    // a bitmap: the status bitmap for DocumentStatusIs, the live bitmap otherwise. Documents left
+    // are checked with IsAccepted, which is resolved at compile time for the built-in predicates
+    // and only calls user predicates.
+    template <typename DocumentPredicate>
+    const uint64_t* GetFilterBits(const DocumentPredicate& document_predicate) const {
+        if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusIs>) {
+            return document_columns_.GetStatusBits(document_predicate.status);
+        } else {
+            return document_columns_.GetLiveBits();
+        }
+    }
+
+    template <typename DocumentPredicate>
+    bool IsAccepted(const DocumentPredicate& document_predicate, int document_number) const {
+        if constexpr (std::is_same_v<DocumentPredicate, AnyDocument> || std::is_same_v<DocumentPredicate, DocumentStatusIs>) {
+            return true;
+        } else if constexpr (std::is_same_v<DocumentPredicate, DocumentRatingAtLeast>) {
+            return document_columns_.GetRating(document_number) >= document_predicate.min_rating;
+        } else {
+            return document_predicate(document_columns_.GetId(document_number),
+                document_columns_.GetStatus(document_number), document_columns_.GetRating(document_number));
+        }
+    }
+
+    // Dense per-thread accumulator for a window of consecutive document numbers
+    struct ScoreWindow {
+        static constexpr int64_t SIZE = 1 << 16;
+
+        std::vector<double> relevances = std::vector<double>(SIZE);
+        std::vector<uint64_t> matched = std::vector<uint64_t>(SIZE / 64);
+        std::vector<uint64_t> excluded = std::vector<uint64_t>(SIZE / 64);
+    };
+
+    static ScoreWindow& GetThreadScoreWindow();
+
+    struct PlusTermCursor {
+        PostingList::Cursor cursor;
+        double inverse_document_freq;
+        // Upper bound of the score the term gives a document
+        double max_score;
+        size_t query_pos;
+    };
+
+    // Per-thread buffers of the query path. They are cleared rather than freed between queries,
+    // so once they have grown to the size of typical queries a sequential query allocates
+    // nothing but its result. The parsed query and the matched documents are held only by
+    // sequential evaluation, which never runs other work on the thread meanwhile; the rest is
+    // scratch space of the single-threaded evaluation steps.
+    struct QueryContext {
+        std::vector<std::string_view> words;
+        Query query;
+        std::vector<Document> matched_documents;
+
+        std::vector<PlusTermCursor> plus_terms;
+        std::vector<PostingList::Cursor> minus_cursors;
+        std::vector<double> inverse_document_freqs;
+        std::vector<double> term_freqs;
+        std::vector<double> max_score_prefix;
+    };
+
+    static QueryContext& GetThreadQueryContext();
+
+    // Appends documents numbered in [first_number, last_number) matching the query in ascending number order
+    template <typename DocumentPredicate>
+    void ScoreDocumentRange(const Query& query, DocumentPredicate document_predicate,
+        int64_t first_number, int64_t last_number, std::vector<Document>& matched_documents) const;
+
+    // Splits a batch into groups of queries likely to share posting lists
+    std::vector<std::vector<size_t>> GroupBatchQueries(const std::vector<Query>& queries) const;
+
+    // Batch evaluation core: results of query i are written to slots[i * max_result_count...]
+    // and their number to result_counts[i]
+    template <class ExecutionPolicy, typename QueryIt>
+    void FindTopDocumentsToSlots(ExecutionPolicy&& policy, QueryIt first, QueryIt last,
+        DocumentStatus status, size_t max_result_count, Document* slots, size_t* result_counts) const;
+
+    // Computes results of the queries listed in group, scanning every posting list once for all of them
+    void FindTopDocumentsForGroup(const std::vector<Query>& queries, const std::vector<size_t>& group,
+        DocumentStatus status, size_t max_result_count, Document* slots, size_t* result_counts) const;
+
+    // Document-at-a-time MaxScore evaluation, see QueryEvaluation::MAX_SCORE
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsMaxScore(const Query& query, DocumentPredicate document_predicate,
+        size_t max_result_count) const;
+};
+
+template <typename StringContainer>
+SearchServer::SearchServer(const StringContainer& stop_words)
+    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
+    using namespace std::string_literals;
+    if (!std::all_of(stop_words_.begin(), stop_words_.end(), IsValidWord)) {
+        throw std::invalid_argument("invalid characters in stop_words"s);
+    }
+}
+
+template <typename DocumentRange>
+void SearchServer::AddDocuments(const DocumentRange& documents) {
+    AddDocuments(std::execution::seq, documents);
+}
+
+template <class ExecutionPolicy, typename DocumentRange>
+void SearchServer::AddDocuments(ExecutionPolicy&& policy, const DocumentRange& documents) {
+    std::vector<DocumentToIndex> documents_to_index;
+    for (const auto& document : documents) {
+        const auto& [document_id, text, status, ratings] = document;
+        documents_to_index.push_back({ document_id, text, status, ComputeAverageRating(ratings) });
+    }
+    AddDocumentBatch(documents_to_index,
+        std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>);
+}
+
+template <class ExecutionPolicy>
+void SearchServer::RemoveDocument(ExecutionPolicy&& policy, int document_id) {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+        RemoveDocument(document_id);
+    } else if (document_numbers_.count(document_id) > 0) {
+        //removal is a few bit and counter updates, there is nothing to spread across threads
+        RemoveDocument(document_id);
+    }
+}
+
+template <typename Func>
+void SearchServer::ForEachDocumentWordId(int document_id, Func func) const {
+    ForEachDocumentTerm(document_numbers_.at(document_id), [&func](TermId term, double) { func(term); });
+}
+
+template <typename Func>
+void SearchServer::ForEachDocumentTerm(int document_number, Func func) const {
+    if (static_cast<size_t>(document_number) < snapshot_rows_.size()) {
+        snapshot_->ForEachDocumentTerm(snapshot_rows_[document_number], func);
+        return;
+    }
+    for (const auto [term, term_freq] : document_term_freqs_[document_number]) {
+        func(term, term_freq);
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_result_count);
+}
+
+template <class ExecutionPolicy, typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query,
+    DocumentPredicate document_predicate, size_t max_result_count) const {
+    // Parallel evaluation may run other queries on this thread while waiting for its tasks,
+    // so it keeps the query and its matches in a local context
+    constexpr bool is_parallel = std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>;
+    QueryContext local_context;
+    QueryContext& context = is_parallel ? local_context : GetThreadQueryContext();
+
+    ParseQuery(raw_query, context.words, context.query);
+    // Only status queries are cached, other predicates have no identity to key the results by
+    bool is_cached = false;
+    DocumentStatus cached_status = DocumentStatus::ACTUAL;
+    if constexpr (std::is_same_v<DocumentPredicate, DocumentStatusIs>) {
+        is_cached = result_cache_.IsEnabled();
+        cached_status = document_predicate.status;
+    }
+    const ResultCache::Key cache_key{ context.query.plus_terms, context.query.minus_terms,
+        cached_status, max_result_count };
+    std::vector<Document> results;
+    if (is_cached && result_cache_.Find(cache_key, index_epoch_, results)) {
+        return results;
+    }
+
+    if (query_evaluation_ == QueryEvaluation::MAX_SCORE) {
+        results = FindTopDocumentsMaxScore(context.query, document_predicate, max_result_count);
+    } else {
+        FindAllDocuments(policy, context.query, document_predicate, context.matched_documents);
+        results = SelectTopDocuments(policy, context.matched_documents, max_result_count);
+    }
+    if (is_cached) {
+        result_cache_.Insert(cache_key, index_epoch_, results);
+    }
+    return results;
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query, DocumentStatus status,
+    size_t max_result_count) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatusIs{ status }, max_result_count);
+}
+
+template <class ExecutionPolicy>
+std::vector<Document> SearchServer::FindTopDocuments(ExecutionPolicy&& policy, const std::string_view raw_query) const {
+    return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
+}
+
+template <class ExecutionPolicy, typename QueryContainer>
+std::vector<std::vector<Document>> SearchServer::FindTopDocumentsBatch(ExecutionPolicy&& policy, const QueryContainer& raw_queries,
+    DocumentStatus status, size_t max_result_count) const {
+    const size_t query_count = raw_queries.size();
+    std::vector<Document> slots(query_count * max_result_count);
+    std::vector<size_t> result_counts(query_count);
+    FindTopDocumentsToSlots(policy, raw_queries.begin(), raw_queries.end(), status, max_result_count,
+        slots.data(), result_counts.data());
+
+    std::vector<std::vector<Document>> results(query_count);
+    for (size_t i = 0; i < query_count; ++i) {
+        const auto query_slots = slots.begin() + i * max_result_count;
+        results[i].assign(query_slots, query_slots + result_counts[i]);
+    }
+    return results;
+}
+
+template <class ExecutionPolicy, typename QueryIt>
+void SearchServer::FindTopDocumentsJoined(ExecutionPolicy&& policy, QueryIt first, QueryIt last, std::vector<Document>& joined_results,
+    DocumentStatus status, size_t max_result_count) const {
+    const size_t query_count = std::distance(first, last);
+    const size_t joined_count = joined_results.size();
+    joined_results.resize(joined_count + query_count * max_result_count);
+    std::vector<size_t> result_counts(query_count);
+    FindTopDocumentsToSlots(policy, first, last, status, max_result_count,
+        joined_results.data() + joined_count, result_counts.data());
+
+    // Results are moved towards the front in place, closing the gaps of unused slots
+    auto out = joined_results.begin() + joined_count;
+    for (size_t i = 0; i < query_count; ++i) {
+        const auto query_slots = joined_results.begin() + joined_count + i * max_result_count;
+        if (out != query_slots) {
+            std::copy(query_slots, query_slots + result_counts[i], out);
+        }
+        out += result_counts[i];
+    }
+    joined_results.erase(out, joined_results.end());
+}
+
+template <class ExecutionPolicy, typename QueryIt>
+void SearchServer::FindTopDocumentsToSlots(ExecutionPolicy&& policy, QueryIt first, QueryIt last,
+    DocumentStatus status, size_t max_result_count, Document* slots, size_t* result_counts) const {
+    std::vector<Query> queries(std::distance(first, last));
+    std::transform(policy, first, last, queries.begin(),
+        [this](const auto& raw_query) { return ParseQuery(raw_query); });
+
+    const std::vector<std::vector<size_t>> groups = GroupBatchQueries(queries);
+    std::for_each(policy, groups.begin(), groups.end(), [&](const std::vector<size_t>& group) {
+        FindTopDocumentsForGroup(queries, group, status, max_result_count, slots, result_counts);
+    });
+}
+
+template <class ExecutionPolicy, typename DocumentPredicate>
+    void SearchServer::FindAllDocuments(ExecutionPolicy&& policy, const Query& query, DocumentPredicate document_predicate,
+                                      std::vector<Document>& matched_documents) const {
+        matched_documents.clear();
+        ScoreDocumentRange(query, document_predicate, 0, std::numeric_limits<int64_t>::max(), matched_documents);
+    }
+
+    template <typename DocumentPredicate>
+    void SearchServer::FindAllDocuments(const std::execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate,
+        std::vector<Document>& matched_documents) const {
+        // Id ranges are scored independently with no shared state, several ranges per thread balance the load
+        constexpr size_t RANGES_PER_THREAD = 4;
+        constexpr size_t MIN_POSTINGS_PER_RANGE = 4096;
+
+        size_t longest_posting_count = 0;
+        const PostingList* longest_postings = nullptr;
+        for (const TermId term : query.plus_terms) {
+            if (term_postings_[term].size() >= longest_posting_count) {
+                longest_posting_count = term_postings_[term].size();
+                longest_postings = &term_postings_[term];
+            }
+        }
+        matched_documents.clear();
+        if (longest_postings == nullptr) {
+            return;
+        }
+
+        const size_t range_count = std::max<size_t>(1, std::min<size_t>(
+            std::max(1u, std::thread::hardware_concurrency()) * RANGES_PER_THREAD,
+            longest_posting_count / MIN_POSTINGS_PER_RANGE));
+        std::vector<int64_t> range_bounds{ 0 };
+        for (const int document_id : longest_postings->GetSplitIds(range_count)) {
+            range_bounds.push_back(document_id);
+        }
+        range_bounds.push_back(std::numeric_limits<int64_t>::max());
+
+        std::vector<std::vector<Document>> range_documents(range_bounds.size() - 1);
+        std::vector<size_t> ranges(range_documents.size());
+        std::iota(ranges.begin(), ranges.end(), 0);
+        std::for_each(policy, ranges.begin(), ranges.end(), [&](size_t range) {
+            ScoreDocumentRange(query, document_predicate, range_bounds[range], range_bounds[range + 1],
+                range_documents[range]);
+        });
+
+        size_t matched_count = 0;
+        std::vector<size_t> offsets(range_documents.size());
+        for (size_t range = 0; range < range_documents.size(); ++range) {
+            offsets[range] = matched_count;
+            matched_count += range_documents[range].size();
+        }
+        matched_documents.resize(matched_count);
+        std::for_each(policy, ranges.begin(), ranges.end(), [&](size_t range) {
+            std::copy(range_documents[range].begin(), range_documents[range].end(),
+                matched_documents.begin() + offsets[range]);
+        });
+    }
+
+template <typename DocumentPredicate>
+void SearchServer::ScoreDocumentRange(const Query& query, DocumentPredicate document_predicate,
+    int64_t first_number, int64_t last_number, std::vector<Document>& matched_documents) const {
+    QueryContext& context = GetThreadQueryContext();
+    std::vector<PlusTermCursor>& plus_terms = context.plus_terms;
+    plus_terms.clear();
+    for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+        const PostingList& postings = term_postings_[query.plus_terms[i]];
+        if (postings.empty()) {
+            continue;
+        }
+        const double inverse_document_freq = ComputeTermInverseDocumentFreq(query.plus_terms[i]);
+        plus_terms.push_back({ postings.GetCursor(), inverse_document_freq,
+            postings.MaxTermFreq() * inverse_document_freq, i });
+        plus_terms.back().cursor.SeekGE(static_cast<int>(first_number));
+    }
+    std::vector<PostingList::Cursor>& minus_cursors = context.minus_cursors;
+    minus_cursors.clear();
+    for (const TermId term : query.minus_terms) {
+        minus_cursors.push_back(term_postings_[term].GetCursor());
+    }
+
+    const uint64_t* filter_bits = GetFilterBits(document_predicate);
+    const int64_t row_count = static_cast<int64_t>(document_columns_.size());
+
+    ScoreWindow& window = GetThreadScoreWindow();
+    while (true) {
+        // Windows start at the word of the next posting, so sparse postings never produce empty
+        // windows, and window words line up with the words of the filter bitmap
+        int64_t window_begin = last_number;
+        for (const PlusTermCursor& plus_term : plus_terms) {
+            if (!plus_term.cursor.AtEnd()) {
+                window_begin = std::min<int64_t>(window_begin, plus_term.cursor.DocumentId());
+            }
+        }
+        if (window_begin >= last_number) {
+            break;
+        }
+        window_begin -= window_begin % 64;
+        const int64_t window_end = std::min({ last_number, window_begin + ScoreWindow::SIZE, row_count });
+        const size_t word_count = static_cast<size_t>(window_end - window_begin + 63) / 64;
+        const uint64_t* window_filter_bits = filter_bits + window_begin / 64;
+
+        // Plus terms are summed in query order, so relevance does not depend on the partitioning
+        for (PlusTermCursor& plus_term : plus_terms) {
+            PostingList::Cursor& cursor = plus_term.cursor;
+            for (; !cursor.AtEnd() && cursor.DocumentId() < window_end; cursor.Next()) {
+                const size_t pos = static_cast<size_t>(cursor.DocumentId() - window_begin);
+                const uint64_t bit = uint64_t{ 1 } << (pos % 64);
+                if ((window.matched[pos / 64] & bit) == 0) {
+                    window.matched[pos / 64] |= bit;
+                    window.relevances[pos] = 0.0;
+                }
+                window.relevances[pos] += cursor.TermFreq() * plus_term.inverse_document_freq;
+            }
+        }
+        for (PostingList::Cursor& cursor : minus_cursors) {
+            for (cursor.SeekGE(static_cast<int>(window_begin)); !cursor.AtEnd() && cursor.DocumentId() < window_end; cursor.Next()) {
+                const size_t pos = static_cast<size_t>(cursor.DocumentId() - window_begin);
+                window.excluded[pos / 64] |= uint64_t{ 1 } << (pos % 64);
+            }
+        }
+
+        for (size_t word = 0; word < word_count; ++word) {
+            const uint64_t candidates = window.matched[word] & ~window.excluded[word] & window_filter_bits[word];
+            for (uint64_t bits = candidates; bits != 0; bits &= bits - 1) {
+                const size_t pos = word * 64 + __builtin_ctzll(bits);
+                const int document_number = static_cast<int>(window_begin + pos);
+                if (IsAccepted(document_predicate, document_number)) {
+                    matched_documents.push_back({ document_columns_.GetId(document_number), window.relevances[pos],
+                        document_columns_.GetRating(document_number) });
+                }
+            }
+            window.matched[word] = 0;
+            window.excluded[word] = 0;
+        }
+    }
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsMaxScore(const Query& query, DocumentPredicate document_predicate,
+    size_t max_result_count) const {
+    // Candidates are compared with the current top using their score upper bounds, the margin keeps
+    // documents that could tie with the top within DELTA (and bound rounding errors) from being skipped
+    constexpr double PRUNING_MARGIN = 2 * DELTA;
+
+    QueryContext& context = GetThreadQueryContext();
+    const size_t plus_term_count = query.plus_terms.size();
+    std::vector<double>& inverse_document_freqs = context.inverse_document_freqs;
+    inverse_document_freqs.assign(plus_term_count, 0.0);
+    std::vector<PlusTermCursor>& plus_terms = context.plus_terms;
+    plus_terms.clear();
+    size_t posting_count = 0;
+    for (size_t i = 0; i < plus_term_count; ++i) {
+        const PostingList& postings = term_postings_[query.plus_terms[i]];
+        if (postings.empty()) {
+            continue;
+        }
+        inverse_document_freqs[i] = ComputeTermInverseDocumentFreq(query.plus_terms[i]);
+        plus_terms.push_back({ postings.GetCursor(), inverse_document_freqs[i],
+            postings.MaxTermFreq() * inverse_document_freqs[i], i });
+        posting_count += postings.size();
+    }
+    std::sort(plus_terms.begin(), plus_terms.end(),
+        [](const PlusTermCursor& lhs, const PlusTermCursor& rhs) { return lhs.max_score < rhs.max_score; });
+
+    // max_score_prefix[i] bounds the score a document gets from the first i terms
+    std::vector<double>& max_score_prefix = context.max_score_prefix;
+    max_score_prefix.assign(plus_terms.size() + 1, 0.0);
+    for (size_t i = 0; i < plus_terms.size(); ++i) {
+        max_score_prefix[i + 1] = max_score_prefix[i] + plus_terms[i].max_score;
+    }
+
+    std::vector<PostingList::Cursor>& minus_cursors = context.minus_cursors;
+    minus_cursors.clear();
+    for (const TermId term : query.minus_terms) {
+        minus_cursors.push_back(term_postings_[term].GetCursor());
+    }
+
+    const uint64_t* filter_bits = GetFilterBits(document_predicate);
+    TopDocumentsCollector collector(max_result_count);
+    collector.Reserve(GetDocumentCount());
+    double threshold = -std::numeric_limits<double>::infinity();
+    // Terms before first_essential alone cannot lift a document into the top
+    size_t first_essential = 0;
+    size_t scored_posting_count = 0;
+    std::vector<double>& term_freqs = context.term_freqs;
+    term_freqs.assign(plus_term_count, 0.0);
+
+    while (max_result_count > 0) {
+        int candidate = std::numeric_limits<int>::max();
+        bool has_candidate = false;
+        for (size_t i = first_essential; i < plus_terms.size(); ++i) {
+            if (!plus_terms[i].cursor.AtEnd()) {
+                candidate = std::min(candidate, plus_terms[i].cursor.DocumentId());
+                has_candidate = true;
+            }
+        }
+        if (!has_candidate) {
+            break;
+        }
+
+        std::fill(term_freqs.begin(), term_freqs.end(), 0.0);
+        double score_bound = max_score_prefix[first_essential];
+        for (size_t i = first_essential; i < plus_terms.size(); ++i) {
+            PostingList::Cursor& cursor = plus_terms[i].cursor;
+            if (!cursor.AtEnd() && cursor.DocumentId() == candidate) {
+                term_freqs[plus_terms[i].query_pos] = cursor.TermFreq();
+                score_bound += cursor.TermFreq() * inverse_document_freqs[plus_terms[i].query_pos];
+                ++scored_posting_count;
+                cursor.Next();
+            }
+        }
+        for (size_t i = first_essential; i-- > 0 && score_bound >= threshold - PRUNING_MARGIN;) {
+            PostingList::Cursor& cursor = plus_terms[i].cursor;
+            score_bound -= plus_terms[i].max_score;
+            cursor.SeekGE(candidate);
+            if (!cursor.AtEnd() && cursor.DocumentId() == candidate) {
+                term_freqs[plus_terms[i].query_pos] = cursor.TermFreq();
+                score_bound += cursor.TermFreq() * inverse_document_freqs[plus_terms[i].query_pos];
+                ++scored_posting_count;
+            }
+        }
+        if (score_bound < threshold - PRUNING_MARGIN) {
+            continue;
+        }
+
+        if (((filter_bits[candidate / 64] >> (candidate % 64)) & 1) == 0) {
+            continue;
+        }
+        const bool has_minus_word = std::any_of(minus_cursors.begin(), minus_cursors.end(),
+            [candidate](PostingList::Cursor& cursor) {
+                cursor.SeekGE(candidate);
+                return !cursor.AtEnd() && cursor.DocumentId() == candidate;
+            });
+        if (has_minus_word) {
+            continue;
+        }
+        if (!IsAccepted(document_predicate, candidate)) {
+            continue;
+        }
+
+        // Summed in query order to get exactly the relevance of the exhaustive evaluation
+        double relevance = 0.0;
+        for (size_t i = 0; i < plus_term_count; ++i) {
+            if (term_freqs[i] > 0.0) {
+                relevance += term_freqs[i] * inverse_document_freqs[i];
+            }
+        }
+        collector.Add({ document_columns_.GetId(candidate), relevance, document_columns_.GetRating(candidate) });
+
+        if (collector.IsFull()) {
+            threshold = collector.Worst().relevance;
+            while (first_essential < plus_terms.size()
+                && max_score_prefix[first_essential + 1] < threshold - PRUNING_MARGIN) {
+                ++first_essential;
+            }
+        }
+    }
+
+    pruning_counters_.query_count += 1;
+    pruning_counters_.posting_count += posting_count;
+    pruning_counters_.skipped_posting_count += posting_count - scored_posting_count;
+
+    return collector.Extract();
+}
\ No newline at end of file
@@ -1,16 +1,118 @@
-#include "string_processing.h"
-
-std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
-    std::string_view text_ = text;
-    std::vector<std::string_view> words;
-    text_.remove_prefix(std::min(text_.size(), text_.find_first_not_of(" ")));
-    const int64_t pos_end = text_.npos;
-
-    while (!text_.empty()) {
-        int64_t space = text_.find(' ', 0);
-        words.push_back(space == pos_end ? text_.substr(0) : text_.substr(0, space));
-        text_.remove_prefix(std::min(text_.size(), static_cast<size_t>(space)));
-        text_.remove_prefix(std::min(text_.size(), text_.find_first_not_of(" ")));
-    }
-    return words;
-}
\ No newline at end of file
+#include "string_processing.h"
+
+#include <cstdint>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+constexpr size_t CHUNK_SIZE = 64;
+
+// Bit i of the masks describes byte i of the 64 bytes at data
+struct ChunkMasks {
+    uint64_t spaces = 0;
+    uint64_t control_chars = 0;
+};
+
+ChunkMasks ClassifyChunk(const char* data) {
+    ChunkMasks masks;
+#if defined(__AVX2__)
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control_char = _mm256_set1_epi8(0x1F);
+    for (size_t offset = 0; offset < CHUNK_SIZE; offset += 32) {
+        const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + offset));
+        const uint32_t spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, space)));
+        // Unsigned bytes <= 0x1F are the ones left unchanged by min(byte, 0x1F)
+        const uint32_t control_chars = static_cast<uint32_t>(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(bytes, last_control_char), bytes)));
+        masks.spaces |= static_cast<uint64_t>(spaces) << offset;
+        masks.control_chars |= static_cast<uint64_t>(control_chars) << offset;
+    }
+#elif defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i last_control_char = _mm_set1_epi8(0x1F);
+    for (size_t offset = 0; offset < CHUNK_SIZE; offset += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + offset));
+        const uint32_t spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, space)));
+        // Unsigned bytes <= 0x1F are the ones left unchanged by min(byte, 0x1F)
+        const uint32_t control_chars = static_cast<uint32_t>(_mm_movemask_epi8(
+            _mm_cmpeq_epi8(_mm_min_epu8(bytes, last_control_char), bytes)));
+        masks.spaces |= static_cast<uint64_t>(spaces) << offset;
+        masks.control_chars |= static_cast<uint64_t>(control_chars) << offset;
+    }
+#else
+    for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+        const unsigned char c = static_cast<unsigned char>(data[i]);
+        masks.spaces |= static_cast<uint64_t>(c == ' ') << i;
+        masks.control_chars |= static_cast<uint64_t>(c < 0x20) << i;
+    }
+#endif
+    return masks;
+}
+
+int CountTrailingZeros(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int count = 0;
+    for (; (value & 1) == 0; value >>= 1) {
+        ++count;
+    }
+    return count;
+#endif
+}
+
+} // namespace
+
+std::vector<std::string_view> SplitIntoWords(const std::string_view text) {
+    std::vector<std::string_view> words;
+    SplitIntoWords(text, words);
+    return words;
+}
+
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words) {
+    words.clear();
+    const char* data = text.data();
+    const size_t size = text.size();
+    bool has_control_chars = false;
+    bool in_word = false;
+    size_t word_begin = 0;
+
+    size_t pos = 0;
+    for (; pos + CHUNK_SIZE <= size; pos += CHUNK_SIZE) {
+        const ChunkMasks masks = ClassifyChunk(data + pos);
+        has_control_chars |= masks.control_chars != 0;
+        // Set bits mark bytes where a word starts or ends, i.e. where being in a word changes
+        const uint64_t word_bytes = ~masks.spaces;
+        uint64_t boundaries = word_bytes ^ ((word_bytes << 1) | static_cast<uint64_t>(in_word));
+        for (; boundaries != 0; boundaries &= boundaries - 1) {
+            const size_t boundary = pos + CountTrailingZeros(boundaries);
+            if (in_word) {
+                words.push_back(text.substr(word_begin, boundary - word_begin));
+            } else {
+                word_begin = boundary;
+            }
+            in_word = !in_word;
+        }
+    }
+    for (; pos < size; ++pos) {
+        const unsigned char c = static_cast<unsigned char>(data[pos]);
+        has_control_chars |= c < 0x20;
+        if ((c != ' ') != in_word) {
+            if (in_word) {
+                words.push_back(text.substr(word_begin, pos - word_begin));
+            } else {
+                word_begin = pos;
+            }
+            in_word = !in_word;
+        }
+    }
+    if (in_word) {
+        words.push_back(text.substr(word_begin));
+    }
+    return !has_control_chars;
+}
@@ -1,19 +1,24 @@
-#pragma once
-
-#include <string>
-#include <string_view>
-#include <vector>
-#include <set>
-
-std::vector<std::string_view> SplitIntoWords(const std::string_view text);
-
-template <typename StringContainer>
-std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
-    std::set<std::string, std::less<>> non_empty_strings;
-    for (const std::string_view str : strings) {
-        if (!str.empty()) {
-            non_empty_strings.insert(std::string{str.begin(), str.end()});
-        }
-    }
-    return non_empty_strings;
-}
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+
+std::vector<std::string_view> SplitIntoWords(const std::string_view text);
+
+// Stores the words of text, separated by spaces, into words, reusing its capacity.
+// Returns false if text contains control characters (bytes below 0x20), the words are
+// stored either way. Spaces and control characters are found in a single vectorized pass.
+bool SplitIntoWords(const std::string_view text, std::vector<std::string_view>& words);
+
+template <typename StringContainer>
+std::set<std::string, std::less<>> MakeUniqueNonEmptyStrings(const StringContainer& strings) {
+    std::set<std::string, std::less<>> non_empty_strings;
+    for (const std::string_view str : strings) {
+        if (!str.empty()) {
+            non_empty_strings.insert(std::string{str.begin(), str.end()});
+        }
+    }
+    return non_empty_strings;
+}
@@ -0,0 +1,86 @@
+#include "term_dictionary.h"
+
+#include <utility>
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : terms_(other.terms_)
+    , free_ids_(other.free_ids_) {
+    Compact();
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        std::swap(ids_, copy.ids_);
+        std::swap(terms_, copy.terms_);
+        std::swap(free_ids_, copy.free_ids_);
+        std::swap(text_, copy.text_);
+        std::swap(live_bytes_, copy.live_bytes_);
+        std::swap(erased_bytes_, copy.erased_bytes_);
+    }
+    return *this;
+}
+
+TermId TermDictionary::Intern(std::string_view term) {
+    const auto it = ids_.find(term);
+    if (it != ids_.end()) {
+        return it->second;
+    }
+
+    const std::string_view stored_term = text_.Store(term);
+    TermId id = static_cast<TermId>(terms_.size());
+    if (free_ids_.empty()) {
+        terms_.push_back(stored_term);
+    } else {
+        id = free_ids_.back();
+        free_ids_.pop_back();
+        terms_[id] = stored_term;
+    }
+    ids_.emplace(stored_term, id);
+    live_bytes_ += term.size();
+    return id;
+}
+
+void TermDictionary::Erase(TermId id) {
+    ids_.erase(terms_[id]);
+    erased_bytes_ += terms_[id].size();
+    live_bytes_ -= terms_[id].size();
+    terms_[id] = {};
+    free_ids_.push_back(id);
+
+    if (erased_bytes_ >= MIN_COMPACTION_BYTES && erased_bytes_ > live_bytes_) {
+        Compact();
+    }
+}
+
+void TermDictionary::AssignExternal(const std::vector<std::string_view>& terms) {
+    ids_.clear();
+    terms_ = terms;
+    free_ids_.clear();
+    text_.Clear();
+    live_bytes_ = 0;
+    erased_bytes_ = 0;
+    // Reversed, so that erased ids are reused in ascending order
+    for (TermId id = static_cast<TermId>(terms_.size()); id-- > 0;) {
+        if (terms_[id].empty()) {
+            free_ids_.push_back(id);
+        } else {
+            ids_.emplace(terms_[id], id);
+            live_bytes_ += terms_[id].size();
+        }
+    }
+}
+
+void TermDictionary::Compact() {
+    TextArena text;
+    ids_.clear();
+    for (TermId id = 0; id < terms_.size(); ++id) {
+        if (!terms_[id].empty()) {
+            terms_[id] = text.Store(terms_[id]);
+            ids_.emplace(terms_[id], id);
+        }
+    }
+    text_ = std::move(text);
+    live_bytes_ = text_.StoredBytes();
+    erased_bytes_ = 0;
+}
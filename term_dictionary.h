@@ -0,0 +1,67 @@
+#pragma once
+
+#include "text_arena.h"
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+using TermId = uint32_t;
+
+// Maps every distinct word to a dense integer id, assigned in order of first appearance.
+// Spellings are copied into an arena owned by the dictionary, so interned words need not
+// outlive it. Ids of erased terms are reused by the next new terms; the arena is compacted
+// once erased spellings take more space than live ones.
+class TermDictionary {
+public:
+    inline static constexpr TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+    TermDictionary() = default;
+    TermDictionary(const TermDictionary& other);
+    TermDictionary& operator=(const TermDictionary& other);
+
+    // Returns the id of the term, registering it first if needed
+    TermId Intern(std::string_view term);
+
+    // Forgets the term, its id may be handed out again
+    void Erase(TermId id);
+
+    // Replaces the contents with terms given in id order, empty ones marking unused ids.
+    // Spellings are not copied and must outlive the dictionary or its next compaction.
+    void AssignExternal(const std::vector<std::string_view>& terms);
+
+    // Returns NO_TERM if the term is unknown
+    TermId Find(std::string_view term) const {
+        const auto it = ids_.find(term);
+        return it == ids_.end() ? NO_TERM : it->second;
+    }
+
+    // Empty for erased ids
+    std::string_view GetTerm(TermId id) const {
+        return terms_[id];
+    }
+
+    // Upper bound of ids handed out, including erased ones
+    size_t size() const {
+        return terms_.size();
+    }
+
+    // Bytes held by the spellings of terms
+    size_t TextMemoryUsage() const {
+        return text_.MemoryUsage();
+    }
+
+    // Copies live spellings into a fresh arena, releasing the space of erased ones
+    void Compact();
+
+private:
+    static constexpr size_t MIN_COMPACTION_BYTES = 64 * 1024;
+
+    std::unordered_map<std::string_view, TermId> ids_;
+    std::vector<std::string_view> terms_;
+    std::vector<TermId> free_ids_;
+    TextArena text_;
+    size_t live_bytes_ = 0;
+    size_t erased_bytes_ = 0;
+};
@@ -0,0 +1,1131 @@
+#include "test_example_functions.h"
+
+#include "concurrent_search_server.h"
+#include "index_snapshot.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "request_queue.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "test_framework.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <execution>
+#include <iterator>
+#include <map>
+#include <new>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+using namespace std::string_literals;
+
+// Counting allocations replaces the global operator new of the whole program, so it is only
+// built into a test binary compiled with -DSEARCH_SERVER_COUNT_ALLOCATIONS
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+// Allocations made by the current thread, counted by the replaced operator new below
+static thread_local size_t allocation_count = 0;
+
+void* operator new(size_t size) {
+    ++allocation_count;
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// GCC pairs the inlined free with the new-expressions of the standard containers and takes it
+// for a mismatch, not knowing operator new above is malloc
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+namespace {
+
+SearchServer MakeTestServer() {
+    SearchServer search_server("and with"s);
+    search_server.AddDocument(1, "white cat and yellow hat"s, DocumentStatus::ACTUAL, { 1, 2 });
+    search_server.AddDocument(2, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 3 });
+    search_server.AddDocument(3, "nasty dog with big eyes"s, DocumentStatus::ACTUAL, { 4, 5 });
+    search_server.AddDocument(4, "nasty pigeon john"s, DocumentStatus::BANNED, { 1 });
+    search_server.AddDocument(5, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, { -1 });
+    return search_server;
+}
+
+// Both servers return the same documents for every query and status, relevances may differ
+// by max_error
+void AssertSameResults(const SearchServer& lhs, const SearchServer& rhs, const std::vector<std::string>& queries,
+    double max_error = 1e-12) {
+    ASSERT_EQUAL(lhs.GetDocumentCount(), rhs.GetDocumentCount());
+    for (const std::string& query : queries) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            const std::vector<Document> lhs_documents = lhs.FindTopDocuments(query, status);
+            const std::vector<Document> rhs_documents = rhs.FindTopDocuments(query, status);
+            AssertEqual(lhs_documents.size(), rhs_documents.size(), query);
+            for (size_t i = 0; i < lhs_documents.size(); ++i) {
+                AssertEqual(lhs_documents[i].id, rhs_documents[i].id, query);
+                AssertEqual(lhs_documents[i].rating, rhs_documents[i].rating, query);
+                Assert(std::abs(lhs_documents[i].relevance - rhs_documents[i].relevance) <= max_error, query);
+            }
+        }
+    }
+}
+
+struct TestDocument {
+    std::string text;
+    DocumentStatus status;
+    int rating;
+};
+
+// Words w0 to w39, w0 and w1 being stop words, so that every query matches many documents
+std::string MakeRandomText(std::mt19937& generator, size_t max_word_count) {
+    std::string text;
+    const size_t word_count = 1 + generator() % max_word_count;
+    for (size_t i = 0; i < word_count; ++i) {
+        text += (i == 0 ? "w"s : " w"s) + std::to_string(generator() % 40);
+    }
+    return text;
+}
+
+std::vector<std::string> MakeRandomQueries(std::mt19937& generator) {
+    std::vector<std::string> queries;
+    for (int i = 0; i < 30; ++i) {
+        std::string query = MakeRandomText(generator, 3);
+        if (i % 3 == 0) {
+            query += " -w"s + std::to_string(generator() % 40);
+        }
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+// Adds step_count random documents and removes about as many, one by one and in batches
+void ChurnServer(SearchServer& search_server, std::map<int, TestDocument>& documents, int& next_id,
+    std::mt19937& generator, int step_count) {
+    for (int step = 0; step < step_count; ++step) {
+        const int document_id = next_id++;
+        TestDocument document{ MakeRandomText(generator, 10), static_cast<DocumentStatus>(generator() % 3),
+            static_cast<int>(generator() % 10) };
+        search_server.AddDocument(document_id, document.text, document.status, { document.rating });
+        documents.emplace(document_id, std::move(document));
+
+        if (generator() % 2 == 0) {
+            auto it = documents.begin();
+            std::advance(it, generator() % documents.size());
+            search_server.RemoveDocument(it->first);
+            documents.erase(it);
+        } else if (generator() % 8 == 0) {
+            std::vector<int> document_ids;
+            for (int i = 0; i < 4 && !documents.empty(); ++i) {
+                auto it = documents.begin();
+                std::advance(it, generator() % documents.size());
+                document_ids.push_back(it->first);
+                documents.erase(it);
+            }
+            search_server.RemoveDocuments(document_ids);
+        }
+    }
+}
+
+SearchServer RebuildServer(const std::map<int, TestDocument>& documents) {
+    SearchServer search_server("w0 w1"s);
+    for (const auto& [document_id, document] : documents) {
+        search_server.AddDocument(document_id, document.text, document.status, { document.rating });
+    }
+    return search_server;
+}
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+// Once the per-thread buffers have grown, a sequential query allocates nothing but its result
+void TestQueryAllocations() {
+    SearchServer search_server = MakeTestServer();
+    const std::string query = "curly nasty cat -collar"s;
+    for (const bool compressed : { false, true }) {
+        if (compressed) {
+            search_server.CompressPostings();
+        }
+        search_server.FindTopDocuments(query);
+        search_server.MatchDocument(query, 2);
+
+        size_t count = allocation_count;
+        const std::vector<Document> documents = search_server.FindTopDocuments(query);
+        count = allocation_count - count;
+        ASSERT_EQUAL(documents.size(), 3u);
+        ASSERT_EQUAL(count, 1u);
+
+        count = allocation_count;
+        const auto [words, status] = search_server.MatchDocument(query, 2);
+        count = allocation_count - count;
+        ASSERT_EQUAL(words.size(), 2u);
+        ASSERT_EQUAL(count, 1u);
+    }
+}
+#endif
+
+// The joined range owns its queries, so it may be built from a temporary vector
+void TestProcessQueriesJoined() {
+    const SearchServer search_server = MakeTestServer();
+    const std::vector<std::string> queries = { "curly cat"s, "nasty -dog"s, "unknown"s, "dog collar"s };
+    std::vector<Document> expected;
+    for (const std::vector<Document>& documents : ProcessQueries(search_server, queries)) {
+        expected.insert(expected.end(), documents.begin(), documents.end());
+    }
+
+    std::vector<int> ids;
+    for (const Document& document : ProcessQueriesJoined(search_server, std::vector<std::string>(queries))) {
+        ids.push_back(document.id);
+    }
+    ASSERT_EQUAL(ids.size(), expected.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        ASSERT_EQUAL(ids[i], expected[i].id);
+    }
+}
+
+// References to joined results must stay valid while later chunks of queries are evaluated
+void TestProcessQueriesJoinedReferencesStayValid() {
+    const SearchServer search_server = MakeTestServer();
+    const std::vector<Document> expected = search_server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(expected.size(), 2u);
+    const auto results = ProcessQueriesJoined(search_server, std::vector<std::string>(600, "cat"s));
+
+    // The last result of the first chunk of queries is held across the evaluation of the next ones
+    auto it = results.begin();
+    std::advance(it, 256 * 2 - 1);
+    const Document& held = *it;
+    const Document* const held_address = &held;
+    size_t count = 256 * 2 - 1;
+    for (; it != results.end(); ++it) {
+        ++count;
+    }
+    ASSERT_EQUAL(count, 600 * expected.size());
+    ASSERT_EQUAL(held.id, expected.back().id);
+    auto again = results.begin();
+    std::advance(again, 256 * 2 - 1);
+    ASSERT(&*again == held_address);
+}
+
+// Saving over the mapped file the server was opened from must leave the mapping readable
+void TestSaveSnapshotOverItself() {
+    const std::string path = "test_search_server_snapshot.bin"s;
+    MakeTestServer().SaveSnapshot(path);
+    {
+        SearchServer search_server = SearchServer::OpenSnapshot(path);
+        search_server.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 2 });
+        search_server.SaveSnapshot(path);
+        ASSERT_EQUAL(search_server.FindTopDocuments("curly cat"s).size(), 4u);
+    }
+    const SearchServer reopened = SearchServer::OpenSnapshot(path);
+    ASSERT_EQUAL(reopened.GetDocumentCount(), 6);
+    ASSERT_EQUAL(reopened.FindTopDocuments("curly cat"s).size(), 4u);
+    std::remove(path.c_str());
+}
+
+// Compaction drops the rows of removed documents and renumbers the others in their order
+void TestCompactionReclaimsRows() {
+    SearchServer search_server = MakeTestServer();
+    search_server.RemoveDocuments({ 1, 3 });
+    ASSERT_EQUAL(search_server.GetIndexMemoryStats().document_row_count, 3u);
+    search_server.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 2 });
+    ASSERT_EQUAL(search_server.GetIndexMemoryStats().document_row_count, 4u);
+
+    const std::vector<Document> documents = search_server.FindTopDocuments("curly nasty cat"s);
+    ASSERT_EQUAL(documents.size(), 3u);
+    ASSERT_EQUAL(documents[0].id, 2);
+    ASSERT_EQUAL(documents[1].id, 6);
+    ASSERT_EQUAL(documents[2].id, 5);
+    ASSERT_EQUAL(documents[2].rating, -1);
+    ASSERT_EQUAL(std::get<0>(search_server.MatchDocument("curly nasty cat"s, 6)).size(), 2u);
+    ASSERT_EQUAL(search_server.GetWordFrequencies(5).size(), 4u);
+    ASSERT_EQUAL(search_server.FindTopDocuments("white"s).size(), 0u);
+}
+
+// Documents added and removed while a compaction is built are carried over when it is applied
+void TestCompactionCarriesOverChanges() {
+    SearchServer search_server = MakeTestServer();
+    search_server.SetCompactOnRemove(false);
+    search_server.RemoveDocuments({ 1, 3 });
+    ASSERT_EQUAL(search_server.GetIndexMemoryStats().document_row_count, 5u);
+
+    std::optional<SearchServer::Compaction> compaction = search_server.PrepareCompaction();
+    ASSERT(compaction.has_value());
+    search_server.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 2 });
+    search_server.RemoveDocument(2);
+    compaction->Build();
+    search_server.ApplyCompaction(*compaction);
+    ASSERT_EQUAL(search_server.GetIndexMemoryStats().document_row_count, 4u);
+
+    SearchServer rebuilt("and with"s);
+    rebuilt.AddDocument(4, "nasty pigeon john"s, DocumentStatus::BANNED, { 1 });
+    rebuilt.AddDocument(5, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, { -1 });
+    rebuilt.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 2 });
+    const std::vector<std::string> queries = { "curly nasty cat"s, "curly -dog"s, "hat tail eyes"s };
+    AssertSameResults(search_server, rebuilt, queries);
+    ASSERT_EQUAL(search_server.GetWordFrequencies(6).size(), 5u);
+
+    search_server.CompactPostings();
+    ASSERT_EQUAL(search_server.GetIndexMemoryStats().document_row_count, 3u);
+    AssertSameResults(search_server, rebuilt, queries);
+}
+
+// A server that went through many additions, removals and compactions answers like one
+// built from its present documents alone
+void TestChurnedServerMatchesRebuilt() {
+    std::mt19937 generator(1);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    for (int round = 0; round < 3; ++round) {
+        ChurnServer(search_server, documents, next_id, generator, 700);
+        const SearchServer rebuilt = RebuildServer(documents);
+        const std::vector<std::string> queries = MakeRandomQueries(generator);
+        AssertSameResults(search_server, rebuilt, queries);
+        for (const auto& [document_id, document] : documents) {
+            ASSERT_EQUAL(search_server.GetWordFrequencies(document_id), rebuilt.GetWordFrequencies(document_id));
+            ASSERT_EQUAL(std::get<0>(search_server.MatchDocument(queries[document_id % queries.size()], document_id)),
+                std::get<0>(rebuilt.MatchDocument(queries[document_id % queries.size()], document_id)));
+        }
+    }
+}
+
+// A server opened from a snapshot answers like the saved one, and keeps doing so under churn
+void TestSnapshotRoundTrip() {
+    const std::string path = "test_search_server_snapshot.bin"s;
+    std::mt19937 generator(2);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 1000);
+    search_server.SaveSnapshot(path);
+    {
+        SearchServer opened = SearchServer::OpenSnapshot(path);
+        AssertSameResults(opened, search_server, MakeRandomQueries(generator));
+
+        ChurnServer(opened, documents, next_id, generator, 500);
+        AssertSameResults(opened, RebuildServer(documents), MakeRandomQueries(generator));
+    }
+    std::remove(path.c_str());
+}
+
+// Compressed postings change relevances by less than TERM_FREQ_ERROR * IDF per plus word
+void TestCompressedMatchesPlain() {
+    std::mt19937 generator(3);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 1000);
+    SearchServer compressed = search_server;
+    compressed.CompressPostings();
+    const double max_error = 3 * 5.1e-9;
+    AssertSameResults(compressed, search_server, MakeRandomQueries(generator), max_error);
+
+    ChurnServer(compressed, documents, next_id, generator, 300);
+    AssertSameResults(compressed, RebuildServer(documents), MakeRandomQueries(generator), max_error);
+}
+
+// Writes a snapshot of documents 10, 11, ... with the given term spellings, the postings of
+// every term and the forward index rows
+void WriteTestSnapshot(const std::string& path, const std::vector<std::string>& terms,
+    const std::vector<std::vector<int>>& term_postings, const std::vector<std::vector<TermId>>& document_terms) {
+    IndexSnapshotHeader header{};
+    header.term_count = terms.size();
+    for (size_t term = 0; term < terms.size(); ++term) {
+        header.term_bytes += terms[term].size();
+        header.posting_count += term_postings[term].size();
+    }
+    header.document_count = document_terms.size();
+    for (const std::vector<TermId>& row : document_terms) {
+        header.document_term_count += row.size();
+    }
+    IndexSnapshotWriter writer(path, header);
+    const IndexSnapshotLayout& layout = writer.GetLayout();
+    writer.StartArray(layout.stop_word_offsets);
+    writer.Write(uint64_t{ 0 });
+    uint64_t offset = 0;
+    writer.StartArray(layout.term_offsets);
+    writer.Write(offset);
+    for (const std::string& term : terms) {
+        writer.Write(offset += term.size());
+    }
+    writer.StartArray(layout.term_chars);
+    for (const std::string& term : terms) {
+        writer.WriteBytes(term.data(), term.size());
+    }
+    offset = 0;
+    writer.StartArray(layout.posting_offsets);
+    writer.Write(offset);
+    for (const std::vector<int>& postings : term_postings) {
+        writer.Write(offset += postings.size());
+    }
+    writer.StartArray(layout.max_term_freqs);
+    for (size_t term = 0; term < terms.size(); ++term) {
+        writer.Write(1.0);
+    }
+    writer.StartArray(layout.posting_ids);
+    for (const std::vector<int>& postings : term_postings) {
+        for (const int document_number : postings) {
+            writer.Write(document_number);
+        }
+    }
+    writer.StartArray(layout.posting_term_freqs);
+    for (uint64_t i = 0; i < header.posting_count; ++i) {
+        writer.Write(1.0);
+    }
+    writer.StartArray(layout.document_ids);
+    for (size_t i = 0; i < document_terms.size(); ++i) {
+        writer.Write(static_cast<int>(10 + i));
+    }
+    writer.StartArray(layout.document_ratings);
+    for (size_t i = 0; i < document_terms.size(); ++i) {
+        writer.Write(0);
+    }
+    writer.StartArray(layout.document_statuses);
+    for (size_t i = 0; i < document_terms.size(); ++i) {
+        writer.Write(static_cast<int>(DocumentStatus::ACTUAL));
+    }
+    offset = 0;
+    writer.StartArray(layout.document_term_offsets);
+    writer.Write(offset);
+    for (const std::vector<TermId>& row : document_terms) {
+        writer.Write(offset += row.size());
+    }
+    writer.StartArray(layout.document_terms);
+    for (const std::vector<TermId>& row : document_terms) {
+        for (const TermId term : row) {
+            writer.Write(term);
+        }
+    }
+    writer.StartArray(layout.document_term_freqs);
+    for (uint64_t i = 0; i < header.document_term_count; ++i) {
+        writer.Write(1.0);
+    }
+    writer.Finish();
+}
+
+// A snapshot with a valid checksum is still rejected if its postings break the list invariants
+// or its spellings do not name the terms with postings one to one
+void TestMalformedSnapshot() {
+    const std::string path = "test_search_server_snapshot.bin"s;
+    WriteTestSnapshot(path, { "cat"s }, { { 0, 1 } }, { { 0 }, { 0 } });
+    {
+        SearchServer search_server = SearchServer::OpenSnapshot(path);
+        search_server.RemoveDocument(10);
+        ASSERT_EQUAL(search_server.FindTopDocuments("cat"s).size(), 1u);
+    }
+    WriteTestSnapshot(path, { "cat"s }, { { 1, 0 } }, { { 0 }, { 0 } });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    WriteTestSnapshot(path, { "cat"s }, { { 0, 0 } }, { { 0 }, { 0 } });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    WriteTestSnapshot(path, { "cat"s }, { { 0, 1 } }, { { 0 }, {} });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    WriteTestSnapshot(path, { "cat"s }, { { 1 } }, { { 0 }, {} });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+
+    // Unused TermIds are saved with empty spellings and handed out again
+    WriteTestSnapshot(path, { "cat"s, ""s, "dog"s }, { { 0 }, {}, { 1 } }, { { 0 }, { 2 } });
+    {
+        SearchServer search_server = SearchServer::OpenSnapshot(path);
+        ASSERT_EQUAL(search_server.FindTopDocuments("dog"s).at(0).id, 11);
+        search_server.AddDocument(12, "bird"s, DocumentStatus::ACTUAL, { 1 });
+        ASSERT_EQUAL(search_server.FindTopDocuments("bird"s).at(0).id, 12);
+    }
+    WriteTestSnapshot(path, { "cat"s, ""s }, { { 0 }, { 1 } }, { { 0 }, { 1 } });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    WriteTestSnapshot(path, { "cat"s, "dog"s }, { { 0, 1 }, {} }, { { 0 }, { 0 } });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    WriteTestSnapshot(path, { "cat"s, "cat"s }, { { 0 }, { 1 } }, { { 0 }, { 1 } });
+    ASSERT_THROWS(SearchServer::OpenSnapshot(path), std::runtime_error);
+    std::remove(path.c_str());
+}
+
+// An update failing on the standby version is not published, one failing after it was published
+// stays published
+void TestConcurrentWriteFailure() {
+    ConcurrentSearchServer search_server(MakeTestServer());
+    ASSERT_THROWS(search_server.Write([](SearchServer& version) {
+        version.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 1 });
+        throw std::runtime_error("update failed"s);
+    }), std::runtime_error);
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 5);
+
+    int call_count = 0;
+    search_server.Write([&call_count](SearchServer& version) {
+        version.AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 1 });
+        if (++call_count == 2) {
+            throw std::runtime_error("update failed"s);
+        }
+    });
+    ASSERT_EQUAL(search_server.GetDocumentCount(), 6);
+    // Both versions hold the change, whichever one the next update publishes
+    for (int i = 0; i < 2; ++i) {
+        search_server.RemoveDocument(1 + i);
+        ASSERT_EQUAL(search_server.FindTopDocuments("curly cat"s).size(), static_cast<size_t>(3 - i));
+    }
+}
+
+// Text of the words w<first>..w<last - 1>, listed backwards so that order is seen to not matter
+std::string MakeWordRange(int first, int last) {
+    std::string text;
+    for (int i = last - 1; i >= first; --i) {
+        text += "w"s + std::to_string(i) + " "s;
+    }
+    return text;
+}
+
+// Clusters hold documents over the threshold in ascending ids, equal word sets always meet
+void TestNearDuplicateClusters() {
+    SearchServer search_server("and"s);
+    search_server.AddDocument(4, MakeWordRange(0, 20), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(2, MakeWordRange(100, 110), DocumentStatus::ACTUAL, { 1 });
+    // 19 common words of 21
+    search_server.AddDocument(1, MakeWordRange(1, 21), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(3, "and "s + MakeWordRange(0, 20), DocumentStatus::BANNED, { 1 });
+    search_server.AddDocument(5, MakeWordRange(100, 110) + "and"s, DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(6, MakeWordRange(200, 210), DocumentStatus::ACTUAL, { 1 });
+
+    const std::vector<std::vector<int>> expected = { { 1, 3, 4 }, { 2, 5 } };
+    ASSERT(FindNearDuplicates(search_server, 0.8) == expected);
+    // Clusters come in the order of their lowest ids
+    const std::vector<std::vector<int>> equal_only = { { 2, 5 }, { 3, 4 } };
+    ASSERT(FindNearDuplicates(search_server, 0.95) == equal_only);
+    ASSERT(FindNearDuplicates(search_server, 1.0) == equal_only);
+    ASSERT_THROWS(FindNearDuplicates(search_server, 0.0), std::invalid_argument);
+    ASSERT_THROWS(FindNearDuplicates(search_server, 1.5), std::invalid_argument);
+}
+
+// The lowest id of a cluster is kept, members chained to it through a removed document are
+// kept too when they are not similar enough to a kept one
+void TestRemoveNearDuplicatesKeepsLowestId() {
+    SearchServer search_server("and"s);
+    // Similarity of neighbours is 19/21, of the first and the third 18/22
+    search_server.AddDocument(3, MakeWordRange(0, 20), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(5, MakeWordRange(1, 21), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(7, MakeWordRange(2, 22), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(9, MakeWordRange(2, 22), DocumentStatus::ACTUAL, { 1 });
+    search_server.AddDocument(8, MakeWordRange(100, 110), DocumentStatus::ACTUAL, { 1 });
+    const std::vector<std::vector<int>> clusters = { { 3, 5, 7, 9 } };
+    ASSERT(FindNearDuplicates(search_server, 0.85) == clusters);
+
+    std::ostringstream output;
+    std::streambuf* const cout_buffer = std::cout.rdbuf(output.rdbuf());
+    RemoveNearDuplicates(search_server, 0.85);
+    std::cout.rdbuf(cout_buffer);
+
+    ASSERT_EQUAL(output.str(), "Found near-duplicate document id 5\nFound near-duplicate document id 9\n"s);
+    const std::vector<int> ids(search_server.begin(), search_server.end());
+    ASSERT(ids == std::vector<int>({ 3, 7, 8 }));
+}
+
+// MaxScore pruning returns what scoring every posting does, removed documents included
+void TestMaxScoreMatchesExhaustive() {
+    std::mt19937 generator(4);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 2000);
+    search_server.SetQueryEvaluation(QueryEvaluation::MAX_SCORE);
+    const std::vector<std::string> queries = MakeRandomQueries(generator);
+    AssertSameResults(search_server, RebuildServer(documents), queries);
+
+    const SearchServer rebuilt = RebuildServer(documents);
+    for (const std::string& query : queries) {
+        for (const size_t max_result_count : { size_t{ 1 }, size_t{ 20 } }) {
+            const auto predicate = [](int document_id, DocumentStatus, int rating) {
+                return document_id % 3 != 0 && rating >= 4;
+            };
+            const std::vector<Document> pruned = search_server.FindTopDocuments(query, predicate, max_result_count);
+            const std::vector<Document> exhaustive = rebuilt.FindTopDocuments(query, predicate, max_result_count);
+            AssertEqual(pruned.size(), exhaustive.size(), query);
+            for (size_t i = 0; i < pruned.size(); ++i) {
+                AssertEqual(pruned[i].id, exhaustive[i].id, query);
+                Assert(std::abs(pruned[i].relevance - exhaustive[i].relevance) <= 1e-12, query);
+            }
+        }
+    }
+    ASSERT(search_server.GetPruningStats().skipped_posting_count > 0);
+}
+
+// Parallel scoring splits the documents into id ranges scored in windows of 65536 numbers,
+// its results equal those of sequential scoring across several windows
+void TestParallelMatchesSequential() {
+    std::mt19937 generator(6);
+    SearchServer search_server("w0 w1"s);
+    std::vector<int> removed_ids;
+    for (int document_id = 0; document_id < 70000; ++document_id) {
+        std::string text;
+        for (size_t i = 0, word_count = 1 + generator() % 4; i < word_count; ++i) {
+            text += " w"s + std::to_string(generator() % 12);
+        }
+        search_server.AddDocument(document_id, text, static_cast<DocumentStatus>(generator() % 3),
+            { static_cast<int>(generator() % 10) });
+        if (generator() % 20 == 0) {
+            removed_ids.push_back(document_id);
+        }
+    }
+    search_server.RemoveDocuments(removed_ids);
+
+    const std::vector<std::string> queries = { "w2"s, "w3 w4 w5"s, "w6 w7 -w8"s, "w9 w10 w11 -w2 -w3"s, "w0 w12"s };
+    const auto predicate = [](int document_id, DocumentStatus status, int rating) {
+        return document_id % 7 != 0 && status != DocumentStatus::REMOVED && rating >= 3;
+    };
+    // Besides a top, all matches are compared, so that no document at a range bound goes missing
+    const size_t all_documents = search_server.GetDocumentCount();
+    for (const std::string& query : queries) {
+        std::vector<std::pair<std::vector<Document>, std::vector<Document>>> results;
+        for (const size_t max_result_count : { size_t{ 10 }, all_documents }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                results.emplace_back(search_server.FindTopDocuments(std::execution::seq, query, status, max_result_count),
+                    search_server.FindTopDocuments(std::execution::par, query, status, max_result_count));
+            }
+            results.emplace_back(search_server.FindTopDocuments(std::execution::seq, query, predicate, max_result_count),
+                search_server.FindTopDocuments(std::execution::par, query, predicate, max_result_count));
+        }
+        for (const auto& [sequential, parallel] : results) {
+            AssertEqual(sequential.size(), parallel.size(), query);
+            for (size_t i = 0; i < sequential.size(); ++i) {
+                AssertEqual(sequential[i].id, parallel[i].id, query);
+                Assert(std::abs(sequential[i].relevance - parallel[i].relevance) <= 1e-12, query);
+            }
+        }
+    }
+}
+
+// A batch shares posting scans among its queries, every result equals that of the query alone
+void TestBatchMatchesSingleQueries() {
+    std::mt19937 generator(8);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 2000);
+    std::vector<std::string> queries = MakeRandomQueries(generator);
+    // Repeated queries, queries left without plus words and queries of a single minus word
+    queries.push_back(queries.front());
+    queries.push_back(""s);
+    queries.push_back("w0 w1"s);
+    queries.push_back("-w5"s);
+    queries.push_back("w5 -w5"s);
+
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT, DocumentStatus::BANNED }) {
+        for (const size_t max_result_count : { size_t{ 1 }, size_t{ 5 }, size_t{ 50 } }) {
+            const std::vector<std::vector<Document>> sequential =
+                search_server.FindTopDocumentsBatch(std::execution::seq, queries, status, max_result_count);
+            const std::vector<std::vector<Document>> parallel =
+                search_server.FindTopDocumentsBatch(std::execution::par, queries, status, max_result_count);
+            ASSERT_EQUAL(sequential.size(), queries.size());
+            ASSERT_EQUAL(parallel.size(), queries.size());
+            for (size_t i = 0; i < queries.size(); ++i) {
+                const std::vector<Document> expected = search_server.FindTopDocuments(queries[i], status, max_result_count);
+                for (const std::vector<Document>& batch : { sequential[i], parallel[i] }) {
+                    AssertEqual(batch.size(), expected.size(), queries[i]);
+                    for (size_t j = 0; j < batch.size(); ++j) {
+                        AssertEqual(batch[j].id, expected[j].id, queries[i]);
+                        AssertEqual(batch[j].rating, expected[j].rating, queries[i]);
+                        Assert(std::abs(batch[j].relevance - expected[j].relevance) <= 1e-12, queries[i]);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Bulk ingestion indexes like adding the documents one by one, down to the word ids, and an
+// invalid item rejects the whole batch
+void TestAddDocumentsMatchesAddDocument() {
+    using DocumentItem = std::tuple<int, std::string, DocumentStatus, std::vector<int>>;
+    std::mt19937 generator(10);
+    std::vector<DocumentItem> items;
+    for (int document_id = 0; document_id < 1500; ++document_id) {
+        items.emplace_back(document_id * 2 + 1, MakeRandomText(generator, 10), static_cast<DocumentStatus>(generator() % 3),
+            std::vector<int>{ static_cast<int>(generator() % 10), static_cast<int>(generator() % 10) });
+    }
+    // The first items are added one by one to every server, so that the batches extend posting lists
+    const auto batch_begin = items.begin() + 200;
+    SearchServer one_by_one("w0 w1"s);
+    for (const auto& [document_id, text, status, ratings] : items) {
+        one_by_one.AddDocument(document_id, text, status, ratings);
+    }
+    SearchServer sequential("w0 w1"s);
+    SearchServer parallel("w0 w1"s);
+    for (SearchServer* search_server : { &sequential, &parallel }) {
+        for (auto it = items.begin(); it != batch_begin; ++it) {
+            const auto& [document_id, text, status, ratings] = *it;
+            search_server->AddDocument(document_id, text, status, ratings);
+        }
+    }
+    sequential.AddDocuments(std::execution::seq, std::vector<DocumentItem>(batch_begin, items.end()));
+    parallel.AddDocuments(std::execution::par, std::vector<DocumentItem>(batch_begin, items.end()));
+
+    const std::vector<std::string> queries = MakeRandomQueries(generator);
+    for (const SearchServer* search_server : { &sequential, &parallel }) {
+        AssertSameResults(*search_server, one_by_one, queries);
+        for (const int document_id : one_by_one) {
+            ASSERT_EQUAL(search_server->GetWordFrequencies(document_id), one_by_one.GetWordFrequencies(document_id));
+            std::vector<uint64_t> word_ids;
+            std::vector<uint64_t> expected_word_ids;
+            search_server->ForEachDocumentWordId(document_id, [&word_ids](uint64_t word_id) { word_ids.push_back(word_id); });
+            one_by_one.ForEachDocumentWordId(document_id, [&expected_word_ids](uint64_t word_id) { expected_word_ids.push_back(word_id); });
+            ASSERT(word_ids == expected_word_ids);
+        }
+    }
+
+    const std::vector<std::vector<DocumentItem>> invalid_batches = {
+        { { 4000, "w2 w3"s, DocumentStatus::ACTUAL, { 1 } }, { -1, "w2"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 4000, "w2 w3"s, DocumentStatus::ACTUAL, { 1 } }, { 4001, "w2 \x12w3"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 4000, "w2 w3"s, DocumentStatus::ACTUAL, { 1 } }, { 1, "w2"s, DocumentStatus::ACTUAL, { 1 } } },
+        { { 4000, "w2 w3"s, DocumentStatus::ACTUAL, { 1 } }, { 4000, "w4"s, DocumentStatus::ACTUAL, { 1 } } },
+    };
+    for (const std::vector<DocumentItem>& batch : invalid_batches) {
+        ASSERT_THROWS(sequential.AddDocuments(std::execution::seq, batch), std::invalid_argument);
+        ASSERT_THROWS(parallel.AddDocuments(std::execution::par, batch), std::invalid_argument);
+    }
+    for (const SearchServer* search_server : { &sequential, &parallel }) {
+        AssertSameResults(*search_server, one_by_one, queries);
+        ASSERT(std::equal(search_server->begin(), search_server->end(), one_by_one.begin(), one_by_one.end()));
+    }
+}
+
+// Words split at spaces one byte at a time, as SplitIntoWords did before it was vectorized
+std::vector<std::string_view> SplitIntoWordsByBytes(std::string_view text) {
+    std::vector<std::string_view> words;
+    size_t word_begin = text.find_first_not_of(' ');
+    while (word_begin != std::string_view::npos) {
+        const size_t word_end = std::min(text.size(), text.find(' ', word_begin));
+        words.push_back(text.substr(word_begin, word_end - word_begin));
+        word_begin = text.find_first_not_of(' ', word_end);
+    }
+    return words;
+}
+
+// The vectorized tokenizer finds the words and control characters a byte by byte scan does,
+// including texts ending within, at and right after 64-byte chunks
+void TestSplitIntoWordsMatchesBytewise() {
+    std::mt19937 generator(14);
+    // Spaces are frequent so that words of all lengths cross chunk bounds
+    const std::string alphabet = "    !abz~\x7f\x80\xff"s;
+    // A text gets at most one of these, so that each of them alone must be found
+    const std::string control_chars = "\0\x01\t\x1f"s;
+    std::vector<std::string_view> words;
+    for (int iteration = 0; iteration < 3000; ++iteration) {
+        const size_t size = iteration < 300 ? iteration : generator() % 300;
+        std::string text;
+        for (size_t i = 0; i < size; ++i) {
+            text += alphabet[generator() % alphabet.size()];
+        }
+        if (size > 0 && generator() % 2 == 0) {
+            text[generator() % size] = control_chars[generator() % control_chars.size()];
+        }
+        const bool is_valid = SplitIntoWords(text, words);
+        ASSERT_EQUAL(is_valid, std::none_of(text.begin(), text.end(), [](char c) {
+            return static_cast<unsigned char>(c) < 0x20;
+        }));
+        ASSERT(words == SplitIntoWordsByBytes(text));
+        ASSERT(SplitIntoWords(text) == words);
+    }
+}
+
+// Duplicates found by word set signatures are those of the original algorithm: a document is
+// removed if a document of lower id has the same set of words
+void TestRemoveDuplicatesMatchesWordSets() {
+    std::mt19937 generator(21);
+    SearchServer search_server("w0 w1"s);
+    std::vector<int> removed_ids;
+    for (int document_id = 0; document_id < 3000; ++document_id) {
+        // Few words of a small vocabulary give many duplicates, stop words only give empty sets
+        std::string text;
+        for (size_t i = 0, word_count = 1 + generator() % 4; i < word_count; ++i) {
+            text += " w"s + std::to_string(generator() % 8);
+        }
+        const int shuffled_id = static_cast<int>((document_id * 7919) % 3000);
+        search_server.AddDocument(shuffled_id, text, DocumentStatus::ACTUAL, { 1 });
+        if (generator() % 10 == 0) {
+            removed_ids.push_back(shuffled_id);
+        }
+    }
+    search_server.RemoveDocuments(removed_ids);
+
+    std::vector<int> expected_ids;
+    std::set<std::set<std::string>> word_sets;
+    for (const int document_id : search_server) {
+        std::set<std::string> words;
+        for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
+            words.emplace(word);
+        }
+        if (!word_sets.insert(std::move(words)).second) {
+            expected_ids.push_back(document_id);
+        }
+    }
+    ASSERT(!expected_ids.empty());
+
+    std::ostringstream output;
+    std::streambuf* const cout_buffer = std::cout.rdbuf(output.rdbuf());
+    RemoveDuplicates(search_server);
+    std::cout.rdbuf(cout_buffer);
+
+    std::ostringstream expected_output;
+    for (const int document_id : expected_ids) {
+        expected_output << "Found duplicate document id "s << document_id << std::endl;
+    }
+    ASSERT_EQUAL(output.str(), expected_output.str());
+    ASSERT_EQUAL(static_cast<size_t>(search_server.GetDocumentCount()), word_sets.size());
+}
+
+// Cached results are keyed by the parsed query, the status and the result count, and any change
+// of the index invalidates them
+void TestResultCacheInvalidation() {
+    SearchServer cached = MakeTestServer();
+    SearchServer uncached = MakeTestServer();
+    cached.SetResultCacheCapacity(16);
+    // Removals must invalidate the results on their own, not through the compaction they may run
+    cached.SetCompactOnRemove(false);
+    uncached.SetCompactOnRemove(false);
+    auto assert_same = [&cached, &uncached](const std::string& query, DocumentStatus status, size_t max_result_count) {
+        const std::vector<Document> lhs = cached.FindTopDocuments(query, status, max_result_count);
+        const std::vector<Document> rhs = uncached.FindTopDocuments(query, status, max_result_count);
+        AssertEqual(lhs.size(), rhs.size(), query);
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            AssertEqual(lhs[i].id, rhs[i].id, query);
+            Assert(std::abs(lhs[i].relevance - rhs[i].relevance) <= 1e-12, query);
+        }
+    };
+    auto assert_stats = [&cached](size_t hit_count, size_t miss_count) {
+        const ResultCacheStats stats = cached.GetResultCacheStats();
+        ASSERT_EQUAL(stats.hit_count, hit_count);
+        ASSERT_EQUAL(stats.miss_count, miss_count);
+    };
+
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(0, 1);
+    // Word order, repeated words and stop words do not change the parsed query
+    assert_same("cat curly and cat"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(1, 1);
+    assert_same("curly cat"s, DocumentStatus::BANNED, 5);
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 1);
+    assert_same("curly cat -tail"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(1, 4);
+    // Queries with other predicates bypass the cache
+    cached.FindTopDocuments("curly cat"s, [](int, DocumentStatus, int) { return true; });
+    assert_stats(1, 4);
+
+    for (SearchServer* search_server : { &cached, &uncached }) {
+        search_server->AddDocument(6, "curly cat in a hat"s, DocumentStatus::ACTUAL, { 2 });
+    }
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(1, 5);
+    ASSERT_EQUAL(cached.FindTopDocuments("curly cat"s).size(), 4u);
+    assert_stats(2, 5);
+
+    for (SearchServer* search_server : { &cached, &uncached }) {
+        search_server->RemoveDocument(2);
+    }
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(2, 6);
+
+    using DocumentItem = std::tuple<int, std::string, DocumentStatus, std::vector<int>>;
+    for (SearchServer* search_server : { &cached, &uncached }) {
+        search_server->AddDocuments(std::vector<DocumentItem>{ { 7, "curly curly cat"s, DocumentStatus::ACTUAL, { 9 } } });
+    }
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 5);
+    for (SearchServer* search_server : { &cached, &uncached }) {
+        search_server->RemoveDocuments({ 1, 7 });
+        search_server->CompactPostings();
+    }
+    assert_same("curly cat"s, DocumentStatus::ACTUAL, 5);
+    assert_stats(2, 8);
+}
+
+// A top of max_result_count documents is the head of the full IsMoreRelevant order: relevance,
+// then rating, then ascending id
+void TestTopDocumentsOrder() {
+    std::mt19937 generator(3);
+    std::vector<Document> documents;
+    for (int id = 0; id < 20000; ++id) {
+        // Few distinct relevances and ratings, so most documents are tied on both
+        documents.emplace_back(static_cast<int>((id * 7919) % 20000), 0.1 * (1 + generator() % 3),
+            static_cast<int>(generator() % 4));
+    }
+    std::vector<Document> sorted = documents;
+    std::sort(sorted.begin(), sorted.end(), IsMoreRelevant);
+    for (const size_t max_count : { size_t{ 0 }, size_t{ 1 }, size_t{ 5 }, size_t{ 1000 }, size_t{ 20000 }, size_t{ 30000 } }) {
+        const std::vector<Document> sequential = SelectTopDocuments(std::execution::seq, documents, max_count);
+        const std::vector<Document> parallel = SelectTopDocuments(std::execution::par, documents, max_count);
+        ASSERT_EQUAL(sequential.size(), std::min(max_count, documents.size()));
+        ASSERT_EQUAL(parallel.size(), sequential.size());
+        for (size_t i = 0; i < sequential.size(); ++i) {
+            ASSERT_EQUAL(sequential[i].id, sorted[i].id);
+            ASSERT_EQUAL(parallel[i].id, sorted[i].id);
+        }
+    }
+
+    SearchServer search_server(""s);
+    for (const int document_id : { 9, 3, 7, 1, 5 }) {
+        search_server.AddDocument(document_id, "cat dog"s, DocumentStatus::ACTUAL, { document_id == 7 ? 5 : 1 });
+    }
+    auto get_ids = [](const std::vector<Document>& found) {
+        std::vector<int> ids;
+        for (const Document& document : found) {
+            ids.push_back(document.id);
+        }
+        return ids;
+    };
+    ASSERT_EQUAL(get_ids(search_server.FindTopDocuments("cat"s)), std::vector<int>({ 7, 1, 3, 5, 9 }));
+    ASSERT_EQUAL(get_ids(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 3)), std::vector<int>({ 7, 1, 3 }));
+    ASSERT_EQUAL(get_ids(search_server.FindTopDocuments(std::execution::par, "cat"s, DocumentStatus::ACTUAL, 3)),
+        std::vector<int>({ 7, 1, 3 }));
+    ASSERT(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+    ASSERT_EQUAL(search_server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 100).size(), 5u);
+}
+
+// Same documents in the same order, relevances may differ by max_error
+void AssertSameDocuments(const std::vector<Document>& lhs, const std::vector<Document>& rhs, const std::string& hint,
+    double max_error = 1e-12) {
+    AssertEqual(lhs.size(), rhs.size(), hint);
+    for (size_t i = 0; i < lhs.size(); ++i) {
+        AssertEqual(lhs[i].id, rhs[i].id, hint);
+        AssertEqual(lhs[i].rating, rhs[i].rating, hint);
+        Assert(std::abs(lhs[i].relevance - rhs[i].relevance) <= max_error, hint);
+    }
+}
+
+// Status queries filter matches by the status bitmaps, which must agree with the statuses
+// a predicate sees, also for rows moved by compaction and across bitmap words
+void TestStatusBitmapsMatchStatuses() {
+    std::mt19937 generator(18);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 1500);
+    // Documents may also be added with the REMOVED status, which has a bitmap of its own
+    for (int i = 0; i < 100; ++i) {
+        search_server.AddDocument(next_id++, MakeRandomText(generator, 10), DocumentStatus::REMOVED, { 1 });
+    }
+    const std::vector<std::string> queries = MakeRandomQueries(generator);
+    const size_t all_documents = search_server.GetDocumentCount();
+
+    for (int round = 0; round < 2; ++round) {
+        for (const std::string& query : queries) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::IRRELEVANT,
+                DocumentStatus::BANNED, DocumentStatus::REMOVED }) {
+                const auto has_status = [status](int, DocumentStatus document_status, int) {
+                    return document_status == status;
+                };
+                const std::vector<Document> found = search_server.FindTopDocuments(query, status, all_documents);
+                AssertSameDocuments(found, search_server.FindTopDocuments(query, has_status, all_documents), query);
+                for (const Document& document : found) {
+                    const auto it = documents.find(document.id);
+                    Assert(it == documents.end() ? status == DocumentStatus::REMOVED : it->second.status == status, query);
+                }
+            }
+        }
+        ChurnServer(search_server, documents, next_id, generator, 500);
+        search_server.CompactPostings();
+    }
+}
+
+// Built-in predicates take specialized scoring loops, their results equal those of the same
+// conditions written as lambdas, with both policies and with MaxScore pruning
+void TestBuiltInPredicatesMatchLambdas() {
+    std::mt19937 generator(19);
+    SearchServer search_server("w0 w1"s);
+    std::map<int, TestDocument> documents;
+    int next_id = 0;
+    ChurnServer(search_server, documents, next_id, generator, 2000);
+    const std::vector<std::string> queries = MakeRandomQueries(generator);
+
+    auto assert_same = [&search_server](const std::string& query, auto built_in, auto lambda) {
+        for (const size_t max_result_count : { size_t{ 5 }, size_t{ 100 } }) {
+            const std::vector<Document> expected = search_server.FindTopDocuments(query, lambda, max_result_count);
+            AssertSameDocuments(search_server.FindTopDocuments(query, built_in, max_result_count), expected, query);
+            AssertSameDocuments(search_server.FindTopDocuments(std::execution::par, query, built_in, max_result_count),
+                expected, query);
+        }
+    };
+    for (const QueryEvaluation query_evaluation : { QueryEvaluation::EXHAUSTIVE, QueryEvaluation::MAX_SCORE }) {
+        search_server.SetQueryEvaluation(query_evaluation);
+        for (const std::string& query : queries) {
+            assert_same(query, AnyDocument{}, [](int, DocumentStatus, int) { return true; });
+            for (const int min_rating : { 0, 5, 9, 10 }) {
+                assert_same(query, DocumentRatingAtLeast{ min_rating },
+                    [min_rating](int, DocumentStatus, int rating) { return rating >= min_rating; });
+            }
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                assert_same(query, DocumentStatusIs{ status },
+                    [status](int, DocumentStatus document_status, int) { return document_status == status; });
+            }
+        }
+    }
+}
+
+// GetNoResultRequests counts the last 1440 requests, whatever their time, while GetStats covers
+// the requests of the time window, from any number of threads
+void TestRequestQueue() {
+    const SearchServer search_server = MakeTestServer();
+    {
+        RequestQueue request_queue(search_server);
+        for (int i = 0; i < 1439; ++i) {
+            request_queue.AddFindRequest("empty request"s);
+        }
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+        request_queue.AddFindRequest("curly dog"s);
+        request_queue.AddFindRequest("big collar"s);
+        request_queue.AddFindRequest("nasty pigeon"s);
+        // The first three requests have dropped out of the last 1440
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1437);
+        const RequestStats stats = request_queue.GetStats();
+        ASSERT_EQUAL(stats.request_count, 1442u);
+        ASSERT_EQUAL(stats.no_result_count, 1439u);
+        ASSERT_EQUAL(stats.result_count_p50, 0u);
+    }
+    {
+        RequestQueue request_queue(search_server);
+        std::vector<std::thread> threads;
+        for (int thread_index = 0; thread_index < 4; ++thread_index) {
+            threads.emplace_back([&request_queue, thread_index]() {
+                for (int i = 0; i < 1000; ++i) {
+                    request_queue.AddFindRequest(thread_index % 2 == 0 ? "sparrow"s : "pigeon"s, DocumentStatus::ACTUAL);
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1440);
+        ASSERT_EQUAL(request_queue.GetStats().request_count, 4000u);
+        ASSERT_EQUAL(request_queue.GetStats().no_result_count, 4000u);
+        for (int i = 0; i < 1439; ++i) {
+            request_queue.AddFindRequest("curly cat"s);
+        }
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+        ASSERT_EQUAL(request_queue.GetStats().request_count, 5439u);
+    }
+    {
+        RequestQueue request_queue(search_server, std::chrono::seconds(1));
+        request_queue.AddFindRequest("sparrow"s);
+        ASSERT_EQUAL(request_queue.GetStats().request_count, 1u);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+        ASSERT_EQUAL(request_queue.GetStats().request_count, 0u);
+        ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1);
+    }
+}
+
+// Queries running alongside updates see every update whole, and once the updates and the
+// background compactions they cause are done, both versions hold the same index
+void TestConcurrentReadersSeeWholeUpdates() {
+    constexpr int BATCH_SIZE = 10;
+    std::mt19937 generator(25);
+    ConcurrentSearchServer search_server(SearchServer("w0 w1"s));
+    std::map<int, TestDocument> documents;
+
+    std::atomic<bool> is_writing = true;
+    std::atomic<size_t> torn_read_count = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&search_server, &is_writing, &torn_read_count]() {
+            while (is_writing.load()) {
+                // Every document has the word common, so a query for it finds all of them
+                const auto [document_count, found_count] = search_server.Read([](const SearchServer& version) {
+                    return std::pair{ static_cast<size_t>(version.GetDocumentCount()),
+                        version.FindTopDocuments("common"s, DocumentStatus::ACTUAL, 1000000).size() };
+                });
+                if (document_count % BATCH_SIZE != 0 || found_count != document_count) {
+                    ++torn_read_count;
+                }
+            }
+        });
+    }
+
+    // Every update adds or removes a whole batch, updates are applied twice so they are prepared
+    // beforehand
+    int next_id = 0;
+    for (int step = 0; step < 200; ++step) {
+        if (step % 3 == 2) {
+            const int first_id = documents.begin()->first;
+            search_server.Write([first_id](SearchServer& version) {
+                for (int id = first_id; id < first_id + BATCH_SIZE; ++id) {
+                    version.RemoveDocument(id);
+                }
+            });
+            documents.erase(documents.begin(), documents.find(first_id + BATCH_SIZE));
+            continue;
+        }
+        std::vector<std::pair<int, std::string>> batch;
+        for (int i = 0; i < BATCH_SIZE; ++i) {
+            batch.emplace_back(next_id, "common "s + MakeRandomText(generator, 10));
+            documents.emplace(next_id++, TestDocument{ batch.back().second, DocumentStatus::ACTUAL, 1 });
+        }
+        search_server.Write([&batch](SearchServer& version) {
+            for (const auto& [document_id, text] : batch) {
+                version.AddDocument(document_id, text, DocumentStatus::ACTUAL, { 1 });
+            }
+        });
+    }
+    is_writing = false;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQUAL(torn_read_count.load(), 0u);
+
+    // An empty update publishes the other version, so both of them are compared
+    const SearchServer rebuilt = RebuildServer(documents);
+    const std::vector<std::string> queries = MakeRandomQueries(generator);
+    for (int i = 0; i < 2; ++i) {
+        search_server.Read([&rebuilt, &queries](const SearchServer& version) {
+            AssertSameResults(version, rebuilt, queries);
+            return 0;
+        });
+        search_server.Write([](SearchServer&) {});
+    }
+}
+
+}  // namespace
+
+void TestSearchServer() {
+    TestRunner tr;
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+    RUN_TEST(tr, TestQueryAllocations);
+#endif
+    RUN_TEST(tr, TestProcessQueriesJoined);
+    RUN_TEST(tr, TestProcessQueriesJoinedReferencesStayValid);
+    RUN_TEST(tr, TestSaveSnapshotOverItself);
+    RUN_TEST(tr, TestCompactionReclaimsRows);
+    RUN_TEST(tr, TestCompactionCarriesOverChanges);
+    RUN_TEST(tr, TestChurnedServerMatchesRebuilt);
+    RUN_TEST(tr, TestSnapshotRoundTrip);
+    RUN_TEST(tr, TestCompressedMatchesPlain);
+    RUN_TEST(tr, TestMalformedSnapshot);
+    RUN_TEST(tr, TestConcurrentWriteFailure);
+    RUN_TEST(tr, TestNearDuplicateClusters);
+    RUN_TEST(tr, TestRemoveNearDuplicatesKeepsLowestId);
+    RUN_TEST(tr, TestMaxScoreMatchesExhaustive);
+    RUN_TEST(tr, TestParallelMatchesSequential);
+    RUN_TEST(tr, TestBatchMatchesSingleQueries);
+    RUN_TEST(tr, TestAddDocumentsMatchesAddDocument);
+    RUN_TEST(tr, TestSplitIntoWordsMatchesBytewise);
+    RUN_TEST(tr, TestRemoveDuplicatesMatchesWordSets);
+    RUN_TEST(tr, TestResultCacheInvalidation);
+    RUN_TEST(tr, TestTopDocumentsOrder);
+    RUN_TEST(tr, TestStatusBitmapsMatchStatuses);
+    RUN_TEST(tr, TestBuiltInPredicatesMatchLambdas);
+    RUN_TEST(tr, TestRequestQueue);
+    RUN_TEST(tr, TestConcurrentReadersSeeWholeUpdates);
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+// Runs the unit tests of the search server, failures are reported to std::cerr
+void TestSearchServer();
@@ -0,0 +1,37 @@
+#include "text_arena.h"
+
+#include <algorithm>
+
+std::string_view TextArena::Store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    char* data = nullptr;
+    if (text.size() > MAX_SHARED_TEXT_SIZE) {
+        data = Allocate(text.size());
+    } else {
+        if (current_block_used_ + text.size() > BLOCK_SIZE) {
+            current_block_ = Allocate(BLOCK_SIZE);
+            current_block_used_ = 0;
+        }
+        data = current_block_ + current_block_used_;
+        current_block_used_ += text.size();
+    }
+    std::copy(text.begin(), text.end(), data);
+    stored_bytes_ += text.size();
+    return { data, text.size() };
+}
+
+void TextArena::Clear() {
+    blocks_.clear();
+    current_block_ = nullptr;
+    current_block_used_ = BLOCK_SIZE;
+    stored_bytes_ = 0;
+    allocated_bytes_ = 0;
+}
+
+char* TextArena::Allocate(size_t size) {
+    blocks_.emplace_back(new char[size]);
+    allocated_bytes_ += size;
+    return blocks_.back().get();
+}
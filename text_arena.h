@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage for many short strings. Text is copied into large blocks that are
+// never moved or shrunk, so returned views stay valid until the arena is cleared or destroyed.
+class TextArena {
+public:
+    TextArena() = default;
+    TextArena(TextArena&&) = default;
+    TextArena& operator=(TextArena&&) = default;
+
+    // Returns a view of the stored copy of text
+    std::string_view Store(std::string_view text);
+
+    void Clear();
+
+    // Bytes of stored text
+    size_t StoredBytes() const {
+        return stored_bytes_;
+    }
+
+    // Bytes held by the blocks
+    size_t MemoryUsage() const {
+        return allocated_bytes_;
+    }
+
+private:
+    static constexpr size_t BLOCK_SIZE = 64 * 1024;
+    // Longer texts get a block of their own instead of wasting the tail of the current one
+    static constexpr size_t MAX_SHARED_TEXT_SIZE = BLOCK_SIZE / 16;
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    char* current_block_ = nullptr;
+    size_t current_block_used_ = BLOCK_SIZE;
+    size_t stored_bytes_ = 0;
+    size_t allocated_bytes_ = 0;
+
+    char* Allocate(size_t size);
+};
@@ -0,0 +1,117 @@
+#pragma once
+
+#include "document.h"
+#include <algorithm>
+#include <cmath>
+#include <execution>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+constexpr double DELTA = 1e-6;
+
+// Result ordering: higher relevance first, relevances closer than DELTA are ordered by rating,
+// remaining ties keep ascending id order as the documents are found
+inline bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < DELTA) {
+        if (lhs.rating != rhs.rating) {
+            return lhs.rating > rhs.rating;
+        }
+        return lhs.id < rhs.id;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+// Keeps the max_count most relevant of the documents passed to Add in a bounded heap
+class TopDocumentsCollector {
+public:
+    explicit TopDocumentsCollector(size_t max_count)
+        : max_count_(max_count) {
+    }
+
+    void Add(const Document& document) {
+        if (heap_.size() < max_count_) {
+            heap_.push_back(document);
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        } else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+            std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+            heap_.back() = document;
+            std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        }
+    }
+
+    // Preallocates the heap for a selection from up to candidate_count documents
+    void Reserve(size_t candidate_count) {
+        heap_.reserve(std::min(max_count_, candidate_count));
+    }
+
+    bool IsFull() const {
+        return heap_.size() >= max_count_;
+    }
+
+    // The least relevant of the kept documents, requires a non-empty collector
+    const Document& Worst() const {
+        return heap_.front();
+    }
+
+    // Kept documents ordered by IsMoreRelevant
+    std::vector<Document> Extract() {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        return std::move(heap_);
+    }
+
+    // Writes kept documents ordered by IsMoreRelevant to out and empties the collector
+    template <typename OutputIt>
+    OutputIt ExtractTo(OutputIt out) {
+        std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        out = std::copy(heap_.begin(), heap_.end(), out);
+        heap_.clear();
+        return out;
+    }
+
+private:
+    size_t max_count_;
+    std::vector<Document> heap_;
+};
+
+// Returns the max_count most relevant documents ordered by IsMoreRelevant.
+// The parallel version selects a top of every chunk of the input concurrently and merges them.
+template <class ExecutionPolicy>
+std::vector<Document> SelectTopDocuments(ExecutionPolicy&& policy, const std::vector<Document>& documents, size_t max_count) {
+    if constexpr (std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::parallel_policy>) {
+        constexpr size_t MIN_CHUNK_SIZE = 4096;
+        const size_t chunk_count = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+            documents.size() / MIN_CHUNK_SIZE);
+        if (chunk_count > 1) {
+            std::vector<std::vector<Document>> chunk_tops(chunk_count);
+            std::vector<size_t> chunks(chunk_count);
+            for (size_t i = 0; i < chunk_count; ++i) {
+                chunks[i] = i;
+            }
+            std::for_each(policy, chunks.begin(), chunks.end(), [&](size_t chunk) {
+                TopDocumentsCollector collector(max_count);
+                collector.Reserve(documents.size() / chunk_count + 1);
+                const size_t last = documents.size() * (chunk + 1) / chunk_count;
+                for (size_t i = documents.size() * chunk / chunk_count; i < last; ++i) {
+                    collector.Add(documents[i]);
+                }
+                chunk_tops[chunk] = collector.Extract();
+            });
+
+            TopDocumentsCollector collector(max_count);
+            for (const auto& chunk_top : chunk_tops) {
+                for (const Document& document : chunk_top) {
+                    collector.Add(document);
+                }
+            }
+            return collector.Extract();
+        }
+    }
+
+    TopDocumentsCollector collector(max_count);
+    collector.Reserve(documents.size());
+    for (const Document& document : documents) {
+        collector.Add(document);
+    }
+    return collector.Extract();
+}